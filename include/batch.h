@@ -0,0 +1,58 @@
+#ifndef DDV_BATCH_H_
+#define DDV_BATCH_H_ 1
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#include "json.h"
+#include "json_writer.h"
+#include "utils_lru_cache.h"
+
+namespace batch {
+
+struct Settings {
+	bool is_msgpack = false;
+	json::Writer::Doubles doubles = json::Writer::Doubles::kCompatible;
+	// bytes of route responses kept for reuse, none if zero
+	std::size_t route_cache_size = 0;
+	// bytes of the directories kept for inputs to come
+	std::size_t memory_budget = 0;
+};
+
+struct Stats {
+	std::size_t files_count;
+	std::size_t failures_count;
+	// directories built, the other inputs reused one
+	std::size_t builds_count;
+	std::size_t evictions_count;
+	utils::CacheStats route_cache;
+};
+
+// The files of a directory, in order and leaving out the outputs,
+// or the paths listed one per line in a file.
+// Throws std::system_error
+[[nodiscard]] std::vector<std::string> listInputs(std::string const &path);
+
+// a sibling of the input, <stem>.out<extension>
+[[nodiscard]] std::string getOutputPath(std::string const &input);
+
+/**
+ *	@brief	Answer each input in a file of its own.
+ *
+ *	The inputs are processed at once by the thread pool, which their
+ *	requests are then processed by too. An input is only skimmed to hash
+ *	the sections of its config, and the directory is built once for
+ *	the inputs whose sections are the same, the first of them building
+ *	it while the others wait. Directories are kept for the inputs to come
+ *	while they fit the budget, and the routes of all of them share
+ *	a cache. An input that fails is reported to stderr and the others go on.
+ */
+[[nodiscard]] Stats processFiles(std::vector<std::string> const &inputs,
+	Settings const &);
+
+[[nodiscard]] json::Object describeStats(Stats const &);
+
+} // namespace batch
+
+#endif /* DDV_BATCH_H_ */
@@ -1,22 +1,66 @@
 #ifndef DDV_DESCRIPTION_H_
 #define DDV_DESCRIPTION_H_ 1
 
-#include "json.h"
+#include <array>
+#include <cstdint>
+#include <functional>
+#include <string_view>
+#include <type_traits>
+
+#include "json_view.h"
 #include "transport_directory_config.h"
 
 namespace description {
 
-[[nodiscard]] transport::config::Bus parseBus(json::Object const &);
+[[nodiscard]] transport::config::Bus parseBus(json::view::Object const &);
 
-[[nodiscard]] transport::config::Stop parseStop(json::Object const &);
+[[nodiscard]] transport::config::Stop parseStop(json::view::Object const &);
 
 [[nodiscard]] transport::config::RoutingSettings
-	parseRoutingSettings(json::Object const &);
+	parseRoutingSettings(json::view::Object const &);
 
 [[nodiscard]] transport::config::RenderSettings
-	parseRenderSettings(json::Object const &);
+	parseRenderSettings(json::view::Object const &);
+
+[[nodiscard]] transport::config::Config parseConfig(json::view::Object const &);
+
+/**
+ *	@brief	Read the whole input in one pass.
+ *
+ *	Base requests are read straight into the config without building
+ *	a DOM for them. The config is passed on as soon as the base requests
+ *	and both settings are read, so it can be used while the rest of the
+ *	input is still being read. read_requests is given the reader when it
+ *	reaches stat_requests and must read the array.
+ *	Without on_config the config is not needed, as when the directory
+ *	is loaded from a snapshot: its sections are skipped and may be missing.
+ *	Defined for json::Reader and msgpack::Reader, throws their ParseError
+ *	on malformed input and std::out_of_range if a section is missing.
+ */
+template <typename Reader>
+void readInput(Reader &reader,
+	std::function<void(transport::config::Config &&)> const &on_config,
+	std::function<void(std::type_identity_t<Reader> &)> const &read_requests);
+
+// Same as readInput, for a document whose stat_requests, if any, are skipped
+template <typename Reader>
+[[nodiscard]] transport::config::Config readConfig(Reader &reader);
+
+template <typename Reader>
+struct Outline {
+	// of the text of the sections the config is read from,
+	// the same for documents whose configs are written the same
+	std::uint64_t config_hash;
+	// the texts themselves, to tell apart configs whose hashes collide
+	std::array<std::string_view, 3> config_texts;
+	// where stat_requests start, for a fork of the reader
+	typename Reader::Position requests;
+};
 
-[[nodiscard]] transport::config::Config parseConfig(json::Object const &);
+// Skips through a document to find what it holds without reading it.
+// Throws as readInput does
+template <typename Reader>
+[[nodiscard]] Outline<Reader> outlineInput(Reader &reader);
 
 } // namespace description
 
@@ -1,10 +1,13 @@
 #ifndef DDV_JSON_H_
 #define DDV_JSON_H_ 1
 
+#include <cstddef>
 #include <cstdint>
 #include <iostream>
 #include <map>
+#include <optional>
 #include <string>
+#include <string_view>
 #include <utility>
 #include <variant>
 #include <vector>
@@ -93,6 +96,30 @@ private:
 	Element root;
 };
 
+using Number = std::variant<Int, double>;
+
+/**
+ *	@brief	Parse the text of a number.
+ *
+ *	The result is an Int if the text has neither a fraction nor
+ *	an exponent and fits, otherwise it is the correctly rounded double.
+ *	Returns nothing if the text is not a number as a whole, or if it
+ *	is out of the range of double.
+ */
+[[nodiscard]] std::optional<Number> parseNumber(std::string_view) noexcept;
+
+/**
+ *	@brief	Append a string in quotes, escaped as JSON requires.
+ *
+ *	Quotes, backslashes and control characters are escaped, everything
+ *	else is copied as it is. The string is scanned 16 bytes at a time.
+ */
+void appendQuoted(std::string &out, std::string_view);
+
+[[nodiscard]] std::size_t computeHeapUsage(Element const &) noexcept;
+
+[[nodiscard]] std::size_t computeMemoryUsage(Document const &) noexcept;
+
 [[nodiscard]] Element readElement(std::istream &);
 
 [[nodiscard]] Document readDocument(std::istream &);
@@ -0,0 +1,331 @@
+#ifndef DDV_JSON_VIEW_H_
+#define DDV_JSON_VIEW_H_ 1
+
+#include <cstddef>
+#include <cstdint>
+#include <iosfwd>
+#include <memory>
+#include <memory_resource>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+#include <variant>
+#include <vector>
+
+#include "json.h"
+#include "utils_mapped_file.h"
+#include "utils_memory.h"
+
+namespace json {
+
+namespace detail {
+class Cursor;
+} // namespace json::detail
+
+class ParseError : public std::runtime_error {
+public:
+	ParseError(char const *what, std::size_t offset)
+		: runtime_error{
+			std::string{"json: "} + what + " at offset " +
+			std::to_string(offset)
+		}
+	{
+	}
+};
+
+/**
+ *	@brief	The whole input in one contiguous block of memory.
+ *
+ *	Regular files are mapped, anything else is read until the end.
+ */
+class Buffer {
+public:
+	// throws std::system_error on failure
+	[[nodiscard]] static Buffer map(std::string const &path);
+	// throws std::system_error on failure
+	[[nodiscard]] static Buffer read(int fd);
+
+	[[nodiscard]] std::string_view view() const noexcept
+	{
+		return file_.size() != 0 ? file_.view() : std::string_view{data_};
+	}
+
+private:
+	utils::MappedFile file_;
+	std::string data_;
+};
+
+/**
+ *	@brief	Find the positions that start a token.
+ *
+ *	These are the positions of structural characters, of the opening
+ *	and closing quotes of strings, and of the first characters of other
+ *	scalars, in increasing order. The input is scanned 64 bytes at a time
+ *	with AVX2 or SSE2 where available.
+ *	Throws ParseError if the input ends inside a string.
+ */
+[[nodiscard]] std::vector<std::uint32_t> indexStructure(std::string_view);
+
+// Same, into an index whose memory is reused
+void indexStructure(std::string_view, std::vector<std::uint32_t> &index);
+
+/**
+ *	@brief	Read a document from a buffer.
+ *
+ *	Same as readDocument(std::istream &), but without going through
+ *	a stream character by character.
+ *	Throws ParseError on malformed input.
+ */
+[[nodiscard]] Document readDocument(std::string_view);
+
+/*
+ *	A read-only DOM whose strings refer to the buffer it was read from,
+ *	so the buffer must outlive it. Escape sequences in values are decoded
+ *	only when a string is asked for its value, keys are decoded on reading.
+ *
+ *	All nodes of a document are allocated from its arena and are trivially
+ *	destructible: objects and arrays are flat spans, the members of an
+ *	object are sorted by key. Destroying a document releases the arena
+ *	and nothing else.
+ */
+namespace view {
+
+class String {
+public:
+	String() = default;
+	String(std::string_view raw, bool is_escaped) noexcept
+		: raw_{raw}
+		, is_escaped_{is_escaped}
+	{
+	}
+
+	// the string as it appears in the input, without quotes
+	[[nodiscard]] std::string_view raw() const noexcept
+	{
+		return raw_;
+	}
+
+	[[nodiscard]] bool isEscaped() const noexcept
+	{
+		return is_escaped_;
+	}
+
+	// Throws ParseError on a malformed escape, at its offset in the string
+	[[nodiscard]] std::string decode() const;
+
+	[[nodiscard]] bool operator==(std::string_view str) const
+	{
+		return is_escaped_ ? decode() == str : raw_ == str;
+	}
+
+private:
+	std::string_view raw_;
+	bool is_escaped_ = false;
+};
+
+class Element;
+
+class Object {
+public:
+	using Member = std::pair<std::string_view, Element>;
+
+	Object() = default;
+	// members must be sorted by key, without duplicates
+	Object(Member const *members, std::size_t size) noexcept
+		: members_{members}
+		, size_{size}
+	{
+	}
+
+	// throws std::out_of_range if there is no such key
+	[[nodiscard]] Element const &at(std::string_view key) const;
+	[[nodiscard]] Element const *find(std::string_view key) const noexcept;
+
+	[[nodiscard]] std::size_t size() const noexcept
+	{
+		return size_;
+	}
+
+	[[nodiscard]] Member const *begin() const noexcept;
+	[[nodiscard]] Member const *end() const noexcept;
+
+private:
+	Member const *members_ = nullptr;
+	std::size_t size_ = 0;
+};
+
+using Array = std::span<Element const>;
+
+// Sorts members by key in place and drops all but the first of equal
+// keys, as std::map::emplace would. Returns the number of members left
+[[nodiscard]] std::size_t sortMembers(Object::Member *members,
+	std::size_t size);
+
+class Element : std::variant<Object, Array, String, Int, double, bool> {
+public:
+	using variant::variant;
+	[[nodiscard]] variant const &getBase() const
+	{
+		return *this;
+	}
+
+	[[nodiscard]] Object const &asObject() const
+	{
+		return std::get<Object>(*this);
+	}
+
+	[[nodiscard]] Array const &asArray() const
+	{
+		return std::get<Array>(*this);
+	}
+
+	[[nodiscard]] String const &asString() const
+	{
+		return std::get<String>(*this);
+	}
+
+	[[nodiscard]] Int asInteger() const
+	{
+		return std::get<Int>(*this);
+	}
+
+	[[nodiscard]] double asDouble() const
+	{
+		return std::holds_alternative<double>(*this) ?
+			std::get<double>(*this) :
+			static_cast<double>(std::get<Int>(*this));
+	}
+
+	[[nodiscard]] bool asBoolean() const
+	{
+		return std::get<bool>(*this);
+	}
+};
+
+static_assert(std::is_trivially_destructible_v<Element>);
+
+inline Object::Member const *Object::begin() const noexcept
+{
+	return members_;
+}
+
+inline Object::Member const *Object::end() const noexcept
+{
+	return members_ + size_;
+}
+
+class Document {
+public:
+	[[nodiscard]] Element const &getRoot() const noexcept
+	{
+		return root_;
+	}
+
+	// bytes taken by the arena, including unused space of its blocks
+	[[nodiscard]] std::size_t getMemoryUsage() const noexcept
+	{
+		return arena_->memory.getBytes();
+	}
+
+	// Makes a document with a fresh arena. build is called with the arena
+	// and returns the root, whose nodes must be allocated from it
+	template <typename Build>
+	[[nodiscard]] static Document build(Build &&build)
+	{
+		Document document;
+		document.root_ = std::forward<Build>(build)(document.arena_->resource);
+		return document;
+	}
+
+private:
+	friend Document readDocument(std::string_view);
+
+	struct Arena {
+		utils::CountingResource memory{std::pmr::get_default_resource()};
+		std::pmr::monotonic_buffer_resource resource{&memory};
+	};
+
+	Document();
+
+	std::unique_ptr<Arena> arena_;
+	Element root_;
+};
+
+// Throws ParseError on malformed input
+[[nodiscard]] Document readDocument(std::string_view);
+
+// Copies a view into an independent element
+[[nodiscard]] json::Element toElement(Element const &);
+
+} // namespace json::view
+
+/**
+ *	@brief	Pull reader over the structure of a buffer.
+ *
+ *	Values are read in the order they appear, without building a tree.
+ *	Containers are entered and then iterated with nextMember() or
+ *	nextElement() until they return false; a value that is not needed
+ *	must still be read or skipped. Strings refer to the buffer.
+ *	Throws ParseError on malformed input and on a value of another type.
+ */
+class Reader {
+public:
+	explicit Reader(std::string_view input);
+	// reuses the memory of the index of a reader no longer needed
+	Reader(std::string_view input, std::vector<std::uint32_t> &&index);
+	Reader(Reader &&) noexcept;
+	~Reader();
+
+	void enterObject();
+	// reads the key of the next member, false at the end of the object
+	[[nodiscard]] bool nextMember(view::String &key);
+
+	void enterArray();
+	// false at the end of the array
+	[[nodiscard]] bool nextElement();
+
+	[[nodiscard]] view::String readString();
+	[[nodiscard]] Int readInteger();
+	[[nodiscard]] double readDouble();
+	[[nodiscard]] bool readBoolean();
+
+	// reads the next value into a document of its own
+	[[nodiscard]] view::Document readDocument();
+	// reads the next value into an independent element
+	[[nodiscard]] Element readElement();
+
+	// skips the next value without checking its contents
+	void skip();
+	// skips the next value and returns the text it takes in the input
+	[[nodiscard]] std::string_view readRaw();
+
+	// throws ParseError if anything but whitespace follows the root
+	void finish() const;
+
+	// where the next value starts, to be read later by a fork
+	using Position = std::size_t;
+	[[nodiscard]] Position tell() const noexcept;
+
+	// A reader of the value at the position, which may be used
+	// on another thread. It shares the input and the index with
+	// this reader, so it must not outlive it
+	[[nodiscard]] Reader fork(Position) const;
+
+	// the index, for a reader of another input to reuse,
+	// once this one and its forks are no longer needed
+	[[nodiscard]] std::vector<std::uint32_t> releaseIndex() && noexcept;
+
+private:
+	explicit Reader(std::unique_ptr<detail::Cursor>) noexcept;
+
+private:
+	std::vector<std::uint32_t> index_;
+	std::unique_ptr<detail::Cursor> cursor_;
+};
+
+} // namespace json
+
+#endif /* DDV_JSON_VIEW_H_ */
@@ -0,0 +1,99 @@
+#ifndef DDV_JSON_WRITER_H_
+#define DDV_JSON_WRITER_H_ 1
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+
+#include "json.h"
+#include "json_view.h"
+
+namespace json {
+
+/**
+ *	@brief	Writes JSON into a buffer that is flushed to a descriptor.
+ *
+ *	The text is formatted as writeValue formats it. Tokens are appended
+ *	to one reusable buffer, which is handed to write(2) whenever it grows
+ *	past kFlushSize and on flush(). Commas are put in automatically.
+ */
+class Writer {
+public:
+	enum class Doubles {
+		// six significant digits, as std::ostream writes by default
+		kCompatible,
+		// the shortest text that reads back as the same double
+		kShortest,
+	};
+
+	static constexpr std::size_t kFlushSize = std::size_t{1} << 20;
+
+	// without a descriptor, a negative fd, everything is kept as by a fork
+	explicit Writer(int fd, Doubles doubles = Doubles::kCompatible);
+	Writer(Writer const &) = delete;
+	Writer(Writer &&) noexcept = default;
+	Writer &operator=(Writer const &) = delete;
+	// flushes what is left, ignoring errors
+	~Writer();
+
+	// the number of members or elements is taken by all writers,
+	// though only binary formats need it
+	void beginObject(std::size_t size);
+	void endObject();
+	void beginArray(std::size_t size);
+	void endArray();
+	void writeKey(std::string_view);
+
+	void writeString(std::string_view);
+	void writeInteger(Int);
+	void writeDouble(double);
+	void writeBoolean(bool);
+	void writeElement(Element const &);
+	void writeElement(view::Element const &);
+
+	// Ends a line after a top-level value, the next one is put on
+	// the next line without a comma, as in newline-delimited JSON
+	void endLine();
+
+	// throws std::system_error if the descriptor fails,
+	// does nothing for a fork
+	void flush();
+
+	// A writer with the same settings that keeps everything it writes,
+	// so that values can be written on another thread and joined later
+	[[nodiscard]] Writer fork() const;
+	// writes the values written to the fork as if they were written here
+	void join(Writer const &fork);
+
+	// what is written and not flushed yet, everything for a fork
+	[[nodiscard]] std::string_view view() const noexcept
+	{
+		return buffer_;
+	}
+
+	// bytes taken by the buffer, which does not grow past a few tokens
+	// over kFlushSize
+	[[nodiscard]] std::size_t getMemoryUsage() const noexcept
+	{
+		return buffer_.capacity();
+	}
+
+private:
+	struct Fork {
+	};
+
+	Writer(Fork, Doubles doubles) noexcept;
+
+	void separate();
+	void finishValue();
+
+private:
+	std::string buffer_;
+	int fd_;
+	Doubles doubles_;
+	bool needs_comma_ = false;
+};
+
+} // namespace json
+
+#endif /* DDV_JSON_WRITER_H_ */
@@ -0,0 +1,169 @@
+#ifndef DDV_MSGPACK_H_
+#define DDV_MSGPACK_H_ 1
+
+#include <cstddef>
+#include <cstdint>
+#include <memory_resource>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "json.h"
+#include "json_view.h"
+
+/*
+ *	MessagePack counterparts of json::Reader and json::Writer with the same
+ *	interfaces, so that the input can be read and the responses written
+ *	in either format by the same code. Maps and arrays stand for objects
+ *	and arrays, strings are length-prefixed and are read without copying.
+ */
+namespace msgpack {
+
+class ParseError : public std::runtime_error {
+public:
+	ParseError(char const *what, std::size_t offset)
+		: runtime_error{
+			std::string{"msgpack: "} + what + " at offset " +
+			std::to_string(offset)
+		}
+	{
+	}
+};
+
+/**
+ *	@brief	Pull reader over a MessagePack buffer.
+ *
+ *	See json::Reader. Nil, binary and extension values may be skipped,
+ *	but not read. Throws ParseError on malformed input and on a value
+ *	of another type.
+ */
+class Reader {
+public:
+	explicit Reader(std::string_view input) noexcept;
+
+	void enterObject();
+	[[nodiscard]] bool nextMember(json::view::String &key);
+
+	void enterArray();
+	[[nodiscard]] bool nextElement();
+
+	[[nodiscard]] json::view::String readString();
+	[[nodiscard]] json::Int readInteger();
+	[[nodiscard]] double readDouble();
+	[[nodiscard]] bool readBoolean();
+
+	[[nodiscard]] json::view::Document readDocument();
+	[[nodiscard]] json::Element readElement();
+
+	void skip();
+	[[nodiscard]] std::string_view readRaw();
+
+	// throws ParseError if anything follows the root
+	void finish() const;
+
+	using Position = std::size_t;
+	[[nodiscard]] Position tell() const noexcept;
+	[[nodiscard]] Reader fork(Position) const;
+
+private:
+	enum class Kind {
+		kNil,
+		kBoolean,
+		kUnsigned,
+		kSigned,
+		kFloat,
+		kString,
+		kBinary,
+		kExtension,
+		kArray,
+		kMap,
+	};
+
+	// The value is the length of strings, binaries, extensions and
+	// containers, whose contents follow, and the bits of everything else
+	struct Token {
+		Kind kind;
+		std::uint64_t value;
+	};
+
+	[[noreturn]] void fail(char const *what) const;
+
+	[[nodiscard]] Token readToken();
+	[[nodiscard]] Token readToken(Kind);
+	[[nodiscard]] std::string_view readBytes(std::uint64_t size);
+	[[nodiscard]] std::uint64_t readBigEndian(std::size_t size);
+	[[nodiscard]] json::Int toInteger(Token) const;
+	[[nodiscard]] bool nextItem();
+
+	[[nodiscard]] json::view::Element readView(std::pmr::memory_resource &);
+
+private:
+	std::string_view input_;
+	std::size_t pos_ = 0;
+	// items left in each container entered
+	std::vector<std::uint64_t> remaining_;
+};
+
+/**
+ *	@brief	Writes MessagePack into a buffer that is flushed to a descriptor.
+ *
+ *	See json::Writer. Numbers take the shortest encoding that keeps
+ *	their value.
+ */
+class Writer {
+public:
+	static constexpr std::size_t kFlushSize = std::size_t{1} << 20;
+
+	explicit Writer(int fd);
+	Writer(Writer const &) = delete;
+	Writer(Writer &&) noexcept = default;
+	Writer &operator=(Writer const &) = delete;
+	// flushes what is left, ignoring errors
+	~Writer();
+
+	void beginObject(std::size_t size);
+	void endObject();
+	void beginArray(std::size_t size);
+	void endArray();
+	void writeKey(std::string_view);
+
+	void writeString(std::string_view);
+	void writeInteger(json::Int);
+	void writeDouble(double);
+	void writeBoolean(bool);
+	void writeElement(json::Element const &);
+
+	// throws std::system_error if the descriptor fails,
+	// does nothing for a fork
+	void flush();
+
+	[[nodiscard]] Writer fork() const;
+	void join(Writer const &fork);
+
+	[[nodiscard]] std::size_t getMemoryUsage() const noexcept
+	{
+		return buffer_.capacity();
+	}
+
+private:
+	struct Fork {
+	};
+
+	explicit Writer(Fork) noexcept;
+
+	void appendByte(std::uint8_t);
+	void appendBigEndian(std::uint64_t value, std::size_t size);
+	// a 16-bit length after the given type byte, or a 32-bit length
+	// after the next one
+	void appendLength(std::uint8_t type, std::size_t length);
+	void finishValue();
+
+private:
+	std::string buffer_;
+	int fd_;
+};
+
+} // namespace msgpack
+
+#endif /* DDV_MSGPACK_H_ */
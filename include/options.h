@@ -0,0 +1,80 @@
+#ifndef DDV_OPTIONS_H_
+#define DDV_OPTIONS_H_ 1
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+
+namespace options {
+
+enum class Format {
+	kJson,
+	kMessagePack,
+};
+
+struct Options {
+	Format format = Format::kJson;
+	bool memory_report = false;
+	// write what a Stats request answers of the requests at exit
+	bool request_stats = false;
+	bool shortest_doubles = false;
+	// answer requests one per line, see server::serveLines
+	bool serve = false;
+	// answer them by stages on threads, see server::servePipelined
+	bool pipeline = false;
+	// answer the clients of a socket, see server::listen
+	std::string listen;
+	// the base document of --listen, read again on SIGHUP
+	std::string base;
+	// a directory of networks hosted by name by --listen
+	std::string networks;
+	// bytes of the networks hosted by name kept loaded,
+	// or of the directories kept for the inputs of a batch
+	std::size_t network_memory = std::size_t{1} << 30;
+	// send the input to a server, see server::connect
+	std::string connect;
+	// a directory or a list of inputs, see batch::processFiles
+	std::string batch;
+	// threads answering the clients of a socket, or the lines
+	// of --serve --pipeline, as many as cores if zero
+	std::size_t workers_count = 0;
+	// bytes of route responses kept for reuse, none if zero
+	std::size_t route_cache_size = std::size_t{16} << 20;
+	std::string save_snapshot;
+	std::string load_snapshot;
+};
+
+inline constexpr std::string_view kUsage =
+	"Usage: transport-directory [--format=json|msgpack] [--memory-report]\n"
+	"\t[--request-stats] [--shortest-doubles] [--route-cache=<bytes>]\n"
+	"\t[--serve [--pipeline [--workers=<count>]] |\n"
+	"\t--listen=<address> [--workers=<count>] [--base=<file>]\n"
+	"\t[--networks=<directory> [--network-memory=<bytes>]] |\n"
+	"\t--connect=<address> | --batch=<directory or list>]\n"
+	"\t[--save-snapshot=<file> | --load-snapshot=<file>] < input.json\n"
+	"With --serve, the first line of the input is the base document unless\n"
+	"a snapshot is loaded, and each line after it is a request answered\n"
+	"by a line of the output. --pipeline reads, answers and writes them\n"
+	"on threads of their own, the lines being answered by the workers.\n"
+	"With --listen, the input is the base document and the lines come\n"
+	"from the clients of the socket, such as --connect. It is read\n"
+	"from the file given by --base instead, and then SIGHUP builds\n"
+	"the network again from it or from the snapshot loaded.\n"
+	"--networks hosts a network for each <name>.json base document or\n"
+	"<name>.snapshot in the directory, for the requests with that network,\n"
+	"loaded when first asked for. The others go to the base document,\n"
+	"which is then only read from --base or the snapshot loaded.\n"
+	"--batch answers each input of the directory, or of the list of files\n"
+	"one per line, in <stem>.out<extension> next to it, building\n"
+	"the network once for the inputs with the same base requests\n"
+	"and settings while they fit --network-memory.\n"
+	"--request-stats writes the latencies of the requests answered\n"
+	"by type and how many were not found to stderr at exit.\n"
+	"An address is the path of a Unix domain socket or tcp:<port>";
+
+// throws std::invalid_argument on unknown options and values
+[[nodiscard]] Options parseOptions(int argc, char const *const argv[]);
+
+} // namespace options
+
+#endif /* DDV_OPTIONS_H_ */
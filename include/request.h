@@ -1,16 +1,156 @@
 #ifndef DDV_REQUEST_H_
 #define DDV_REQUEST_H_ 1
 
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <variant>
+#include <vector>
+
 #include "json.h"
 #include "transport_directory.h"
+#include "utils_histogram.h"
+#include "utils_lru_cache.h"
 
 namespace request {
 
-[[nodiscard]] json::Object process(json::Object const &request,
-	transport::TransportDirectory const &database);
+struct Bus {
+	std::string name;
+};
+
+struct Stop {
+	std::string name;
+};
+
+struct Route {
+	std::string from;
+	std::string to;
+};
+
+struct Map {
+};
+
+struct Stats {
+};
+
+struct Request {
+	json::Element id;
+	std::variant<Bus, Stop, Route, Map, Stats> query;
+	// the name of the network it is for, the default one if empty.
+	// Only a server hosts several networks
+	std::string network;
+};
+
+using Requests = std::vector<Request>;
+
+// A request with its names resolved to the ids of a directory.
+// Names the directory does not know make it a kNotFound
+struct Query {
+	enum class Type : std::uint8_t {
+		kBus,
+		kStop,
+		kRoute,
+		kMap,
+		kStats,
+		kNotFound,
+	};
+	static constexpr std::size_t kTypesCount =
+		static_cast<std::size_t>(Type::kNotFound) + 1;
+
+	Type type;
+	// the bus, the stop or the start of the route
+	transport::Id first;
+	// the end of the route
+	transport::Id second;
+};
+
+using Queries = std::vector<Query>;
+
+// The items of a route as written by a fork of the writer, ready to be
+// joined into any response to the same route. The id of the request
+// is all that is left to write
+template <typename Writer>
+struct CachedRoute {
+	// nothing if there is no way between the stops
+	std::optional<Writer> items;
+	double total_time;
+};
+
+// Keyed by the tag of the directory in the high half and the ids
+// of both stops, the start first, in the low half. A cache holds
+// a single format, the one of the writer it is used with
+template <typename Writer>
+using RouteCache = utils::LruCache<std::uint64_t, CachedRoute<Writer>>;
+
+// What process counts of the queries it answers, for the whole process
+struct Metrics {
+	// nanoseconds taken to answer, by the type of query
+	std::array<utils::Histogram, Query::kTypesCount> latencies;
+	// routes asked for between stops with no way between them,
+	// as opposed to stops not found
+	std::atomic<std::size_t> routes_not_found{0};
+	std::atomic<std::size_t> route_cache_hits{0};
+};
+
+[[nodiscard, gnu::const]] Metrics &getMetrics() noexcept;
+
+// Reads a request, throws std::out_of_range on unknown types.
+// Defined for json::Reader and msgpack::Reader
+template <typename Reader>
+[[nodiscard]] Request readRequest(Reader &);
+
+// reads an array of requests as readRequest does
+template <typename Reader>
+[[nodiscard]] Requests readRequests(Reader &);
+
+[[nodiscard]] std::size_t computeMemoryUsage(Requests const &) noexcept;
+
+[[nodiscard]] Query resolve(Request const &,
+	transport::TransportDirectory const &);
+
+// the queries are in the same order as the requests
+[[nodiscard]] Queries resolveAll(Requests const &,
+	transport::TransportDirectory const &);
+
+// Responses are written as they are computed, with keys in sorted order.
+// Routes are looked up in the cache if there is one, which must be used
+// with a single directory for each tag. The time taken is recorded
+// in the metrics. Defined for json::Writer and msgpack::Writer
+
+template <typename Writer>
+void process(Query query, json::Element const &id,
+	transport::TransportDirectory const &database, Writer &writer,
+	std::type_identity_t<RouteCache<Writer>> *cache = nullptr,
+	std::uint32_t cache_tag = 0);
+
+template <typename Writer>
+void process(Request const &request,
+	transport::TransportDirectory const &database, Writer &writer,
+	std::type_identity_t<RouteCache<Writer>> *cache = nullptr);
+
+template <typename Writer>
+void processAll(Requests const &requests,
+	transport::TransportDirectory const &database, Writer &writer,
+	std::type_identity_t<RouteCache<Writer>> *cache = nullptr,
+	std::uint32_t cache_tag = 0);
+
+// the response to a request that is not processed
+template <typename Writer>
+void writeError(std::string_view message, json::Element const &id,
+	Writer &writer);
+
+[[nodiscard]] json::Object describeMemoryUsage(
+	transport::info::MemoryUsage const &usage);
+
+[[nodiscard]] json::Object describeCacheStats(utils::CacheStats const &);
 
-[[nodiscard]] json::Array processAll(json::Array const &requests,
-	transport::TransportDirectory const &database);
+// as answered to a Stats request, times in nanoseconds
+[[nodiscard]] json::Object describeMetrics(Metrics const &);
 
 } // namespace request
 
@@ -0,0 +1,79 @@
+#ifndef DDV_SERVER_H_
+#define DDV_SERVER_H_ 1
+
+#include <cstddef>
+#include <optional>
+#include <string_view>
+
+#include "json.h"
+#include "json_writer.h"
+#include "request.h"
+#include "transport_directory.h"
+#include "utils_io.h"
+#include "utils_queue.h"
+
+namespace server {
+
+using RouteCache = request::RouteCache<json::Writer>;
+
+// The request on a line. Nothing if the line is blank, or if it is not
+// a request, which is then answered by an object with only an error_message,
+// as it may have no id
+[[nodiscard]] std::optional<request::Request> readLine(std::string_view line,
+	json::Writer &);
+
+// Answers each line of the text, the last one may have no '\n', by a line.
+// Blank lines are skipped, as by readLine
+void answerLines(std::string_view lines,
+	transport::TransportDirectory const &, json::Writer &, RouteCache *);
+
+/**
+ *	@brief	Answer requests that come one per line until the input ends.
+ *
+ *	Each request is answered by a line as soon as it is processed.
+ *	The output is flushed only when no more lines are read, so requests
+ *	that came together are answered by a single write.
+ *	Throws std::system_error if reading or writing fails.
+ */
+void serveLines(utils::LineReader &lines,
+	transport::TransportDirectory const &, json::Writer &, RouteCache *);
+
+struct PipelineSettings {
+	// threads answering lines, at least one
+	std::size_t workers_count = 1;
+	// lines queued for each worker, and answers queued from it
+	std::size_t queue_capacity = 256;
+	json::Writer::Doubles doubles = json::Writer::Doubles::kCompatible;
+};
+
+struct PipelineStats {
+	std::size_t workers_count;
+	// summed over the queues from the reader to the workers
+	utils::QueueStats lines;
+	// and over those from the workers to the writer
+	utils::QueueStats answers;
+};
+
+/**
+ *	@brief	Answer lines as serveLines does, by stages on threads of their own.
+ *
+ *	The calling thread reads the lines and hands them out in turn
+ *	to the workers, which parse and answer them. A writer thread takes
+ *	the answers from the workers in the same turn, so they come out
+ *	in the order of the lines, and flushes them whenever the next one
+ *	is not ready yet. Each worker has a bounded queue from the reader
+ *	and one to the writer, so reading and writing go on while lines are
+ *	answered, and a stage that falls behind holds up the one before it
+ *	once its queues are full.
+ *	Throws std::system_error if reading or writing fails.
+ */
+[[nodiscard]] PipelineStats servePipelined(utils::LineReader &lines,
+	int output_fd, transport::TransportDirectory const &, RouteCache *,
+	PipelineSettings const &);
+
+// wait times are in microseconds
+[[nodiscard]] json::Object describePipelineStats(PipelineStats const &);
+
+} // namespace server
+
+#endif /* DDV_SERVER_H_ */
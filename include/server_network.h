@@ -0,0 +1,161 @@
+#ifndef DDV_SERVER_NETWORK_H_
+#define DDV_SERVER_NETWORK_H_ 1
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "json.h"
+#include "server.h"
+#include "transport_directory.h"
+
+namespace server {
+
+// A directory with the tag of its routes in the cache shared by all,
+// as the ids in the cache are only valid for it
+struct Network {
+	Network(transport::TransportDirectory &&, RouteCache &,
+		std::uint64_t generation);
+
+	transport::TransportDirectory directory;
+	RouteCache *route_cache;
+	// unique to the network, so that a network put in a slot in place
+	// of another does not find its routes
+	std::uint32_t cache_tag;
+	// counts the networks put in the slot
+	std::uint64_t generation;
+	// when the network was replaced in the slot, zero until it is
+	mutable std::atomic<std::chrono::steady_clock::rep> replaced_at{0};
+};
+
+struct NetworkStats {
+	std::uint64_t generation;
+	// networks replaced and then destroyed once nobody used them
+	std::size_t reclaimed_count;
+	std::chrono::nanoseconds last_swap;
+	// from a replacement to the destruction
+	std::chrono::nanoseconds max_reclaim_delay;
+};
+
+/**
+ *	@brief	The network being served, which may be replaced while it is.
+ *
+ *	Readers get() the network and hold it for as long as they use it.
+ *	publish() swaps in another one, built beforehand, without waiting
+ *	for them: those that got the old network finish with it, and it is
+ *	destroyed by whichever of them drops it last. The slot is locked only
+ *	to copy or exchange the pointer.
+ */
+class NetworkSlot {
+public:
+	NetworkSlot(transport::TransportDirectory &&, RouteCache &);
+
+	[[nodiscard]] std::shared_ptr<Network const> get() const;
+
+	void publish(transport::TransportDirectory &&);
+
+	[[nodiscard]] NetworkStats getStats() const noexcept;
+
+private:
+	struct Counters;
+
+	[[nodiscard]] std::shared_ptr<Network const> makeNetwork(
+		transport::TransportDirectory &&);
+
+private:
+	RouteCache &route_cache_;
+	std::atomic<std::uint64_t> generation_{0};
+	// shared with the networks, which may outlive the slot
+	std::shared_ptr<Counters> counters_;
+	mutable std::mutex mutex_;
+	std::shared_ptr<Network const> current_;
+};
+
+struct RegistryStats {
+	std::size_t networks_count;
+	std::size_t loaded_count;
+	// of the networks loaded, as they were when last evicting
+	std::size_t loaded_bytes;
+	std::size_t loads_count;
+	std::size_t failures_count;
+	std::size_t evictions_count;
+};
+
+/**
+ *	@brief	Networks hosted by name, loaded when first asked for.
+ *
+ *	A named network is loaded from its file by the first request for it,
+ *	which those that come meanwhile wait for, the other networks are not
+ *	held up. While the networks loaded take more memory than the budget,
+ *	the least recently used are dropped, to be loaded again when asked
+ *	for. Those using a network dropped finish with it, as with a slot.
+ *	All the networks share the route cache, and the default network
+ *	of the requests with no name is never dropped.
+ */
+class NetworkRegistry {
+public:
+	// Loads a network from its file, throws on failure
+	using Load =
+		std::function<transport::TransportDirectory(std::string const &path)>;
+
+	NetworkRegistry(RouteCache &, std::size_t memory_budget, Load);
+	~NetworkRegistry();
+
+	// Networks are set before the registry is shared between threads
+	void setDefault(transport::TransportDirectory &&);
+	void add(std::string name, std::string path);
+
+	// Nothing if there is no such network. Throws std::runtime_error
+	// if it cannot be loaded, until it is reloaded
+	[[nodiscard]] std::shared_ptr<Network const> get(std::string_view name);
+
+	// nothing if there is no default network
+	[[nodiscard]] NetworkSlot *getDefault() noexcept;
+	[[nodiscard]] bool hasNamed() const noexcept;
+	// the named networks loaded, and those that failed to load
+	[[nodiscard]] std::vector<std::string> getLoadedNames() const;
+
+	// Loads a named network again and publishes it if it is still loaded,
+	// nothing if it is not. A failure to load it before is forgotten.
+	// Throws on failure
+	std::optional<NetworkStats> reload(std::string const &name);
+
+	[[nodiscard]] RouteCache const &getRouteCache() const noexcept;
+	[[nodiscard]] RegistryStats getStats() const;
+
+private:
+	struct Entry;
+
+	// drops networks other than the one kept while over the budget
+	void evict(Entry const &kept);
+
+private:
+	RouteCache &route_cache_;
+	std::size_t memory_budget_;
+	Load load_;
+	std::optional<NetworkSlot> default_;
+	std::map<std::string, std::unique_ptr<Entry>, std::less<>> entries_;
+	std::mutex evict_mutex_;
+	std::atomic<std::size_t> loaded_bytes_{0};
+	std::atomic<std::size_t> loads_count_{0};
+	std::atomic<std::size_t> failures_count_{0};
+	std::atomic<std::size_t> evictions_count_{0};
+};
+
+// swaps are in nanoseconds, delays in microseconds
+[[nodiscard]] json::Object describeNetworkStats(NetworkStats const &);
+
+[[nodiscard]] json::Object describeRegistryStats(RegistryStats const &);
+
+} // namespace server
+
+#endif /* DDV_SERVER_NETWORK_H_ */
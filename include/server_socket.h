@@ -0,0 +1,77 @@
+#ifndef DDV_SERVER_SOCKET_H_
+#define DDV_SERVER_SOCKET_H_ 1
+
+#include <array>
+#include <cstddef>
+#include <functional>
+#include <string>
+
+#include "json.h"
+#include "json_writer.h"
+#include "server_network.h"
+#include "transport_directory.h"
+#include "utils_scheduler.h"
+
+namespace server {
+
+// The work of a server by cost. Lines are read and cheap requests
+// answered right away, routes and maps are queued to be answered later
+enum class Work : std::size_t {
+	kLines,
+	kRoutes,
+	kMaps,
+};
+
+inline constexpr std::size_t kWorkKindsCount = 3;
+
+using SchedulerStats = std::array<utils::SchedulerStats, kWorkKindsCount>;
+
+struct SocketSettings {
+	// as taken by utils::listenAt
+	std::string address;
+	std::size_t workers_count;
+	json::Writer::Doubles doubles;
+	// builds the default network again on SIGHUP, not at all if empty.
+	// Called from a thread of its own, throws on failure
+	std::function<transport::TransportDirectory()> reload;
+};
+
+// Blocks SIGINT, SIGTERM and SIGHUP in the calling thread and in the
+// threads it starts later, so that they reach listen(). Must be called
+// before any other thread is started
+void blockServerSignals();
+
+/**
+ *	@brief	Answer the clients of a socket until SIGINT or SIGTERM.
+ *
+ *	Requests come one per line, as for serveLines, and a client may send
+ *	any number of them without waiting, the answers come back in order.
+ *	One thread waits on epoll for all the sockets and hands the lines
+ *	that came to a pool of workers. A client that does not take its
+ *	answers is not read from until it does.
+ *
+ *	The workers take the work of each kind from a queue of its own,
+ *	so that a map or a route that is not cached does not hold up the
+ *	cheap requests behind it. A request that waits too long, or finds
+ *	its queue full, is answered by an "overloaded" error_message.
+ *
+ *	A request is answered by the network it names, or by the default
+ *	one. On SIGHUP the networks loaded are built again by a thread
+ *	of its own and published to their slots. Requests keep being answered
+ *	meanwhile, and those read before the swap by the old network.
+ *	The outcome is logged to stderr. Returns what the queues went through,
+ *	throws std::system_error if the socket cannot be set up.
+ */
+SchedulerStats listen(SocketSettings const &, NetworkRegistry &);
+
+// times are in microseconds
+[[nodiscard]] json::Object describeSchedulerStats(SchedulerStats const &);
+
+// Sends what is read from in_fd to the server at the address and
+// copies the answers to out_fd until the server is done with them.
+// Throws std::system_error on failure
+void connect(std::string const &address, int in_fd, int out_fd);
+
+} // namespace server
+
+#endif /* DDV_SERVER_SOCKET_H_ */
@@ -4,27 +4,45 @@
 #include <memory>
 #include <optional>
 #include <string>
+#include <string_view>
 
 #include "transport_directory_info.h"
 #include "transport_directory_config.h"
 
 namespace transport {
 
+class TransportDirectoryImpl;
+
+// The const methods may be called from several threads at once
 class TransportDirectory {
 public:
 	TransportDirectory(config::Config &&);
+	TransportDirectory(TransportDirectory &&) noexcept;
 	~TransportDirectory();
 
-	[[nodiscard]] std::optional<info::Bus> getBus(
-		std::string const &name) const;
-	[[nodiscard]] std::optional<info::Stop> getStop(
-		std::string const &name) const;
-	[[nodiscard]] std::optional<info::Route> getRoute(
-		std::string const &from, std::string const &to) const;
+	// throws std::system_error or std::runtime_error if the file
+	// cannot be mapped or was written by an incompatible build
+	[[nodiscard]] static TransportDirectory loadSnapshot(
+		std::string const &path);
+	void saveSnapshot(std::string const &path) const;
+
+	// Names are resolved to ids once, the ids are then valid
+	// for as long as the directory is
+	[[nodiscard]] std::optional<Id> findBus(std::string_view name) const;
+	[[nodiscard]] std::optional<Id> findStop(std::string_view name) const;
+
+	[[nodiscard]] info::Bus getBus(Id) const;
+	[[nodiscard]] info::Stop getStop(Id) const;
+	// nothing if there is no way between the stops
+	[[nodiscard]] std::optional<info::Route> getRoute(Id from, Id to) const;
 	[[nodiscard]] info::Map getMap() const;
+	[[nodiscard]] info::MemoryUsage getMemoryUsage() const;
+
+private:
+	explicit TransportDirectory(std::unique_ptr<TransportDirectoryImpl>);
 
 private:
-	std::unique_ptr<class TransportDirectoryImpl> impl_;
+	std::unique_ptr<TransportDirectoryImpl> impl_;
 };
 
 } // namespace transport
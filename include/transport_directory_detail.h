@@ -1,19 +1,17 @@
 #ifndef DDV_TRANSPORT_DIRECTORY_DETAIL_H_
 #define DDV_TRANSPORT_DIRECTORY_DETAIL_H_ 1
 
+#include <cstddef>
 #include <cstdint>
+#include <memory_resource>
 #include <string_view>
-#include <unordered_set>
 #include <variant>
 #include <vector>
 
+#include "transport_directory_info.h"
 #include "utils_structures.h"
 
-namespace transport {
-
-using Id = std::uint16_t;
-
-namespace detail {
+namespace transport::detail {
 
 using StopId = Id;
 using BusId = Id;
@@ -21,16 +19,16 @@ using BusId = Id;
 struct Bus {
 	BusId id;
 	std::string_view name;
-	std::vector<StopId> route;
+	std::pmr::vector<StopId> route;
 	bool is_roundtrip;
+	info::Bus info;
 };
 
 struct Stop {
 	StopId id;
 	std::string_view name;
 	utils::point coords;
-	std::unordered_set<StopId> adjacents;
-	std::unordered_set<BusId> buses;
+	std::pmr::vector<BusId> buses;
 };
 
 struct Route {
@@ -52,8 +50,45 @@ struct Route {
 	Item item;
 };
 
-} // namespace transport::detail
+/**
+ *	Contiguous storage for the names of stops and buses.
+ *
+ *	The pool is carved out of a memory resource in one block of the
+ *	expected size, so that all names lie side by side. Strings that
+ *	do not fit are allocated from the resource separately.
+ *	The pool does not deduplicate strings, this is done by the name maps.
+ */
+class StringPool {
+public:
+	StringPool(std::size_t capacity, std::pmr::memory_resource *resource)
+		: resource_{resource}
+		, begin_{static_cast<char *>(resource->allocate(capacity, 1))}
+		, end_{begin_ + capacity}
+	{
+	}
+
+	StringPool(StringPool const &) = delete;
+	StringPool &operator=(StringPool const &) = delete;
 
-} // namespace transport
+	[[nodiscard]] std::string_view intern(std::string_view str)
+	{
+		char *data;
+		if (str.size() <= static_cast<std::size_t>(end_ - begin_)) {
+			data = begin_;
+			begin_ += str.size();
+		} else {
+			data = static_cast<char *>(resource_->allocate(str.size(), 1));
+		}
+		str.copy(data, str.size());
+		return {data, str.size()};
+	}
+
+private:
+	std::pmr::memory_resource *resource_;
+	char *begin_;
+	char *end_;
+};
+
+} // namespace transport::detail
 
 #endif /* DDV_TRANSPORT_DIRECTORY_DETAIL_H_ */
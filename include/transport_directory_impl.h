@@ -2,14 +2,20 @@
 #define DDV_TRANSPORT_DIRECTORY_IMPL_H_ 1
 
 #include <cstddef>
+#include <memory_resource>
+#include <mutex>
 #include <optional>
+#include <span>
 #include <string>
+#include <string_view>
 #include <unordered_map>
 #include <vector>
 
 #include "transport_directory_config.h"
 #include "transport_directory_detail.h"
 #include "transport_directory_info.h"
+#include "utils_mapped_file.h"
+#include "utils_memory.h"
 
 namespace transport {
 
@@ -20,56 +26,100 @@ private:
 
 public:
 	TransportDirectoryImpl(config::Config &&);
+	explicit TransportDirectoryImpl(utils::MappedFile snapshot);
 
-	[[nodiscard]] std::optional<info::Bus> getBus(
-		std::string const &name) const;
-	[[nodiscard]] std::optional<info::Stop> getStop(
-		std::string const &name) const;
-	[[nodiscard]] std::optional<info::Route> getRoute(
-		std::string const &from, std::string const &to) const;
+	void saveSnapshot(std::string const &path) const;
+
+	[[nodiscard]] std::optional<BusId> findBus(std::string_view name) const;
+	[[nodiscard]] std::optional<StopId> findStop(
+		std::string_view name) const;
+
+	[[nodiscard]] info::Bus getBusInfo(BusId) const;
+	[[nodiscard]] info::Stop getStopInfo(StopId) const;
+	[[nodiscard]] std::optional<info::Route> getRouteInfo(
+		StopId from, StopId to) const;
 	[[nodiscard]] info::Map getMap() const;
+	[[nodiscard]] info::MemoryUsage getMemoryUsage() const;
 
 private:
-	void addBus(config::Bus &&);
-	void addStop(config::Stop &&);
+	void addBus(config::Bus const &);
+	StopId addStop(config::Stop const &);
+	void fillDistances(std::span<config::Item const> stops,
+		bool are_names_unique);
 
 	[[nodiscard]] std::size_t countUniqueId(
-		std::vector<StopId> const &route) const;
+		std::span<StopId const> route) const;
 	[[nodiscard]] double computeRoadRouteLength(
-		std::vector<StopId> const &route) const noexcept;
+		std::span<StopId const> route) const noexcept;
 	[[nodiscard]] double computeGeoRouteLength(
-		std::vector<StopId> const &route) const noexcept;
+		std::span<StopId const> route) const noexcept;
 	[[nodiscard]] auto computeRouteLengths(
-		std::vector<StopId> const& route) const noexcept;
+		std::span<StopId const> route) const noexcept;
 
 	[[nodiscard]] info::Bus makeBusInfo(detail::Bus const &) const;
 	[[nodiscard]] info::Stop makeStopInfo(detail::Stop const &) const;
 	[[nodiscard]] info::Route makeRouteInfo(detail::Route const &) const;
 
+	[[nodiscard]] static std::size_t
+		computeNamesSize(config::Items const &) noexcept;
+	[[nodiscard]] static std::size_t
+		estimateArenaSize(config::Items const &) noexcept;
+
+	void recordPeakRss(std::string_view phase);
+
 	void init(std::size_t stops_count, std::size_t buses_count);
-	void calculateGeoDistances() noexcept;
+	void calculateGeoDistances();
 	void computeRoutes();
 	void fillRoutes();
 	void executeWFI();
+	void relaxRoutes(StopId from, StopId middle) noexcept;
+	void computeBusesInfo();
 
 private:
-	std::unordered_map<std::string, BusId> bus_ids_;
-	std::vector<detail::Bus> buses_;
-	std::unordered_map<std::string, StopId> stop_ids_;
-	std::vector<detail::Stop> stops_;
-
-	std::vector<double> distances_;
-	std::vector<double> geo_distances_;
-	std::vector<detail::Route> routes_;
+	// Everything below is allocated from the arena,
+	// so it must be declared first and destroyed last
+	utils::CountingResource arena_memory_{std::pmr::get_default_resource()};
+	std::pmr::monotonic_buffer_resource arena_;
+
+	// Each structure allocates through its own counter
+	utils::CountingResource names_memory_{&arena_};
+	utils::CountingResource bus_ids_memory_{&arena_};
+	utils::CountingResource buses_memory_{&arena_};
+	utils::CountingResource stop_ids_memory_{&arena_};
+	utils::CountingResource stops_memory_{&arena_};
+	utils::CountingResource distances_memory_{&arena_};
+	utils::CountingResource geo_distances_memory_{&arena_};
+	utils::CountingResource routes_memory_{&arena_};
+
+	detail::StringPool names_;
+
+	std::pmr::unordered_map<std::string_view, BusId> bus_ids_;
+	std::pmr::vector<detail::Bus> buses_;
+	std::pmr::unordered_map<std::string_view, StopId> stop_ids_;
+	std::pmr::vector<detail::Stop> stops_;
+
+	std::pmr::vector<double> distances_;
+	std::pmr::vector<double> geo_distances_;
+	std::pmr::vector<detail::Route> routes_;
+
+	// the route table is either routes_ or a part of the snapshot
+	std::span<detail::Route const> route_table_;
 
 	config::RoutingSettings routing_settings_;
 	config::RenderSettings render_settings_;
 
+	// the map is rendered once, by whichever thread asks for it first
+	mutable std::mutex map_mutex_;
 	mutable std::string map_;
+	mutable std::string_view map_view_;
+
+	utils::MappedFile snapshot_;
+
+	info::MemoryUsage::Entries peak_rss_;
 
 private:
-	detail::Bus &registerBus(std::string name);
-	detail::Stop &registerStop(std::string name);
+	detail::Bus &registerBus(std::string_view name);
+	detail::Stop &registerStop(std::string_view name);
 
 	[[nodiscard]] std::size_t getBusesCount() const noexcept;
 	[[nodiscard]] std::size_t getStopsCount() const noexcept;
@@ -114,25 +164,25 @@ inline std::size_t TransportDirectoryImpl::
 inline decltype(auto) TransportDirectoryImpl::
 	getBusesList() noexcept
 {
-	return buses_;
+	return (buses_);
 }
 
 inline decltype(auto) TransportDirectoryImpl::
 	getBusesList() const noexcept
 {
-	return buses_;
+	return (buses_);
 }
 
 inline decltype(auto) TransportDirectoryImpl::
 	getStopsList() noexcept
 {
-	return stops_;
+	return (stops_);
 }
 
 inline decltype(auto) TransportDirectoryImpl::
 	getStopsList() const noexcept
 {
-	return stops_;
+	return (stops_);
 }
 
 inline double &TransportDirectoryImpl::
@@ -192,7 +242,7 @@ inline detail::Route &TransportDirectoryImpl::
 inline detail::Route const &TransportDirectoryImpl::
 	getRoute(StopId from, StopId to) const noexcept
 {
-	return routes_[from * stops_.size() + to];
+	return route_table_[from * stops_.size() + to];
 }
 
 } // namespace transport
@@ -2,9 +2,17 @@
 #define DDV_TRANSPORT_DIRECTORY_INFO_H_ 1
 
 #include <cstddef>
+#include <cstdint>
 #include <string_view>
 #include <vector>
 
+namespace transport {
+
+// stops and buses are numbered separately, in the order they are added
+using Id = std::uint16_t;
+
+} // namespace transport
+
 namespace transport::info {
 
 struct Stop {
@@ -38,6 +46,20 @@ struct Map {
 	std::string_view data;
 };
 
+struct MemoryUsage {
+	struct Entry {
+		std::string_view name;
+		std::size_t bytes;
+	};
+
+	using Entries = std::vector<Entry>;
+
+	Entries structures;
+	Entries peak_rss;
+	// the bytes held, the other structures are allocated from the arena
+	std::size_t total;
+};
+
 } // namespace transport::info
 
 #endif /* DDV_TRANSPORT_DIRECTORY_INFO_H_ */
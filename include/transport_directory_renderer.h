@@ -1,6 +1,7 @@
 #ifndef DDV_TRANSPORT_DIRECTORY_RENDERER_H_
 #define DDV_TRANSPORT_DIRECTORY_RENDERER_H_ 1
 
+#include <span>
 #include <string>
 #include <utility>
 #include <vector>
@@ -19,8 +20,8 @@ namespace transport {
 
 class TransportDirectoryRenderer {
 public:
-	TransportDirectoryRenderer(std::vector<detail::Bus> const &,
-		std::vector<detail::Stop> const &, config::RenderSettings const &);
+	TransportDirectoryRenderer(std::span<detail::Bus const>,
+		std::span<detail::Stop const>, config::RenderSettings const &);
 
 	[[nodiscard]] std::string renderMap() const;
 
@@ -33,8 +34,8 @@ private:
 	void renderStopLabels(svg::Document &) const;
 
 private:
-	std::vector<detail::Bus> const &buses_;
-	std::vector<detail::Stop> const &stops_;
+	std::span<detail::Bus const> buses_;
+	std::span<detail::Stop const> stops_;
 	config::RenderSettings const &settings_;
 	std::vector<detail::BusID> sorted_bus_ids_;
 	std::vector<detail::StopID> sorted_stop_ids_;
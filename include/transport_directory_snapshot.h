@@ -0,0 +1,78 @@
+#ifndef DDV_TRANSPORT_DIRECTORY_SNAPSHOT_H_
+#define DDV_TRANSPORT_DIRECTORY_SNAPSHOT_H_ 1
+
+#include <array>
+#include <cstdint>
+#include <type_traits>
+
+#include "transport_directory_detail.h"
+
+/*
+ *	Binary image of a built directory.
+ *
+ *	The file starts with a header followed by sections. Sections are
+ *	referenced by their offset from the beginning of the file, so the
+ *	image can be mapped at any address and used in place. Every section
+ *	is aligned to kAlignment. Integers and floating-point numbers are
+ *	stored in the native representation, the header records enough to
+ *	reject a file written by an incompatible build.
+ */
+namespace transport::snapshot {
+
+inline constexpr std::array<char, 8> kMagic = {
+	'T', 'D', 'S', 'N', 'A', 'P', '\0', '\0'
+};
+inline constexpr std::uint32_t kVersion = 1;
+inline constexpr std::uint64_t kAlignment = 64;
+
+struct Section {
+	std::uint64_t offset;
+	std::uint64_t size;
+};
+
+// offset is relative to the names section
+struct String {
+	std::uint64_t offset;
+	std::uint64_t size;
+};
+
+// buses are a range of the stop_buses section, sorted by name
+struct Stop {
+	String name;
+	std::uint64_t buses_begin;
+	std::uint64_t buses_count;
+};
+
+// route is a range of the bus_routes section
+struct Bus {
+	String name;
+	std::uint64_t route_begin;
+	std::uint64_t route_count;
+	std::uint64_t unique_stops_count;
+	double road_route_length;
+	double geo_route_length;
+	std::uint64_t is_roundtrip;
+};
+
+struct Header {
+	std::array<char, 8> magic;
+	std::uint32_t version;
+	std::uint32_t route_size;
+	std::uint64_t stops_count;
+	std::uint64_t buses_count;
+	double wait_time;
+	Section names;
+	Section stops;
+	Section buses;
+	Section bus_routes;
+	Section stop_buses;
+	Section routes;
+	Section map;
+};
+
+static_assert(std::is_trivially_copyable_v<Header>);
+static_assert(std::is_trivially_copyable_v<detail::Route>);
+
+} // namespace transport::snapshot
+
+#endif /* DDV_TRANSPORT_DIRECTORY_SNAPSHOT_H_ */
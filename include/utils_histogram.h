@@ -0,0 +1,76 @@
+#ifndef DDV_UTILS_HISTOGRAM_H_
+#define DDV_UTILS_HISTOGRAM_H_ 1
+
+#include <array>
+#include <atomic>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+
+namespace utils {
+
+struct HistogramSummary {
+	std::uint64_t count;
+	std::uint64_t total;
+	std::uint64_t max;
+	// the highest values of the buckets the percentiles fall in
+	std::uint64_t p50;
+	std::uint64_t p90;
+	std::uint64_t p99;
+	std::uint64_t p999;
+};
+
+/**
+ *	@brief	Counts of values in buckets of bounded relative width.
+ *
+ *	Values below kSubBucketsCount have a bucket each, and each power
+ *	of two above is split into kSubBucketsCount buckets, so a value
+ *	is known to within 1/kSubBucketsCount of itself over the whole range,
+ *	as in HDR histograms. Recording takes a couple of relaxed atomic
+ *	additions and no lock, so it may be done by any number of threads.
+ */
+class Histogram {
+public:
+	static constexpr unsigned kSubBits = 4;
+	static constexpr std::size_t kSubBucketsCount = std::size_t{1} << kSubBits;
+	static constexpr std::size_t kBucketsCount =
+		(64 - kSubBits + 1) * kSubBucketsCount;
+
+	void record(std::uint64_t value) noexcept
+	{
+		buckets_[getBucketIndex(value)].fetch_add(1, std::memory_order_relaxed);
+		total_.fetch_add(value, std::memory_order_relaxed);
+		auto max = max_.load(std::memory_order_relaxed);
+		while (value > max and not max_.compare_exchange_weak(max, value,
+				std::memory_order_relaxed)) {
+		}
+	}
+
+	// Values recorded meanwhile may be counted in some fields only
+	[[nodiscard]] HistogramSummary summarize() const noexcept;
+
+	[[nodiscard, gnu::const]] static std::size_t getBucketIndex(
+		std::uint64_t value) noexcept
+	{
+		if (value < kSubBucketsCount) {
+			return value;
+		}
+		auto exponent = static_cast<unsigned>(std::bit_width(value)) - 1;
+		std::size_t sub_bucket =
+			(value >> (exponent - kSubBits)) & (kSubBucketsCount - 1);
+		return (exponent - kSubBits + 1) * kSubBucketsCount + sub_bucket;
+	}
+
+	// the lowest value of the bucket
+	[[nodiscard, gnu::const]] static std::uint64_t getBucketValue(
+		std::size_t index) noexcept;
+
+private:
+	std::array<std::atomic<std::uint64_t>, kBucketsCount> buckets_{};
+	std::atomic<std::uint64_t> total_{0};
+	std::atomic<std::uint64_t> max_{0};
+};
+
+} // namespace utils
+
+#endif /* DDV_UTILS_HISTOGRAM_H_ */
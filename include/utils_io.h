@@ -0,0 +1,67 @@
+#ifndef DDV_UTILS_IO_H_
+#define DDV_UTILS_IO_H_ 1
+
+#include <cstddef>
+#include <optional>
+#include <string>
+#include <string_view>
+
+namespace utils {
+
+// Owns a descriptor and closes it
+class FileDescriptor {
+public:
+	FileDescriptor() = default;
+	explicit FileDescriptor(int fd) noexcept
+		: fd_{fd}
+	{
+	}
+	FileDescriptor(FileDescriptor &&other) noexcept;
+	FileDescriptor &operator=(FileDescriptor &&other) noexcept;
+	~FileDescriptor();
+
+	[[nodiscard]] int get() const noexcept
+	{
+		return fd_;
+	}
+
+private:
+	int fd_ = -1;
+};
+
+// Writes all of data, retrying on partial writes and EINTR.
+// Throws std::system_error on failure
+void writeAll(int fd, std::string_view data);
+
+/**
+ *	@brief	Splits what is read from a descriptor into lines.
+ *
+ *	Each read(2) takes whatever is available, up to kReadSize,
+ *	so hasLine() tells whether a line can be taken without waiting.
+ */
+class LineReader {
+public:
+	static constexpr std::size_t kReadSize = std::size_t{1} << 16;
+
+	explicit LineReader(int fd) noexcept;
+
+	// The line without its '\n', valid until the next call. The last line
+	// may have no '\n', nothing is returned at the end of the input.
+	// Throws std::system_error on failure
+	[[nodiscard]] std::optional<std::string_view> next();
+
+	[[nodiscard]] bool hasLine() const noexcept;
+
+private:
+	std::string buffer_;
+	// the start of the next line
+	std::size_t begin_ = 0;
+	// there is no '\n' in the buffer before this
+	std::size_t scanned_ = 0;
+	int fd_;
+	bool is_ended_ = false;
+};
+
+} // namespace utils
+
+#endif /* DDV_UTILS_IO_H_ */
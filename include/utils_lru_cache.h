@@ -0,0 +1,172 @@
+#ifndef DDV_UTILS_LRU_CACHE_H_
+#define DDV_UTILS_LRU_CACHE_H_ 1
+
+#include <bitset>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace utils {
+
+struct CacheStats {
+	std::size_t hits;
+	std::size_t misses;
+	std::size_t evictions;
+	std::size_t entries;
+	std::size_t bytes;
+};
+
+/**
+ *	@brief	A cache of bounded size that drops the least recently used.
+ *
+ *	Keys are spread over shards by their hash, each with a lock,
+ *	a list in the order of use and an equal part of the byte budget,
+ *	so threads using different keys rarely wait for each other.
+ *	Values are shared, and stay valid for those who found them
+ *	after they are dropped. A cache with a budget of zero keeps nothing.
+ *
+ *	Keys asked for once would only push out the others, so admit()
+ *	lets the caller make a value only for a key that missed before.
+ */
+template <typename Key, typename Value, typename Hash = std::hash<Key>>
+class LruCache {
+public:
+	static constexpr std::size_t kShardBits = 4;
+	static constexpr std::size_t kShardsCount = std::size_t{1} << kShardBits;
+	static constexpr std::size_t kMissBits = 15;
+	static constexpr std::size_t kMissesCount = std::size_t{1} << kMissBits;
+
+	explicit LruCache(std::size_t budget)
+		: shard_budget_{budget / kShardsCount}
+		, shards_(kShardsCount)
+	{
+	}
+
+	// counts a hit or a miss
+	[[nodiscard]] std::shared_ptr<Value const> find(Key const &key)
+	{
+		auto &shard = shards_[getShardIndex(mix(key))];
+		std::lock_guard lock{shard.mutex};
+		auto it = shard.index.find(key);
+		if (it == shard.index.end()) {
+			++shard.stats.misses;
+			return nullptr;
+		}
+		++shard.stats.hits;
+		shard.entries.splice(shard.entries.begin(), shard.entries, it->second);
+		return it->second->value;
+	}
+
+	// Bytes are what the value is charged for, it is not kept if that
+	// is over the budget of a shard. A value already there is replaced
+	void insert(Key const &key, std::shared_ptr<Value const> value,
+		std::size_t bytes)
+	{
+		bytes += kEntryOverhead;
+		if (bytes > shard_budget_) {
+			return;
+		}
+		auto &shard = shards_[getShardIndex(mix(key))];
+		std::lock_guard lock{shard.mutex};
+		if (auto it = shard.index.find(key); it != shard.index.end()) {
+			shard.stats.bytes -= it->second->bytes;
+			shard.entries.erase(it->second);
+			shard.index.erase(it);
+			--shard.stats.entries;
+		}
+		while (shard.stats.bytes + bytes > shard_budget_) {
+			auto &last = shard.entries.back();
+			shard.stats.bytes -= last.bytes;
+			shard.index.erase(last.key);
+			shard.entries.pop_back();
+			--shard.stats.entries;
+			++shard.stats.evictions;
+		}
+		shard.entries.push_front({key, std::move(value), bytes});
+		shard.index.emplace(key, shard.entries.begin());
+		shard.stats.bytes += bytes;
+		++shard.stats.entries;
+	}
+
+	// True if the key missed before. Misses are remembered by bits
+	// picked by hash, which are all cleared once half of them are set
+	[[nodiscard]] bool admit(Key const &key)
+	{
+		auto hash = mix(key);
+		auto &shard = shards_[getShardIndex(hash)];
+		auto bit = (hash >> (64 - kShardBits - kMissBits)) & (kMissesCount - 1);
+		std::lock_guard lock{shard.mutex};
+		if (shard.misses[bit]) {
+			return true;
+		}
+		if (shard.misses_count == kMissesCount / 2) {
+			shard.misses.reset();
+			shard.misses_count = 0;
+		}
+		shard.misses.set(bit);
+		++shard.misses_count;
+		return false;
+	}
+
+	[[nodiscard]] CacheStats getStats() const
+	{
+		CacheStats total{};
+		for (auto const &shard : shards_) {
+			std::lock_guard lock{shard.mutex};
+			total.hits += shard.stats.hits;
+			total.misses += shard.stats.misses;
+			total.evictions += shard.stats.evictions;
+			total.entries += shard.stats.entries;
+			total.bytes += shard.stats.bytes;
+		}
+		return total;
+	}
+
+private:
+	struct Entry {
+		Key key;
+		std::shared_ptr<Value const> value;
+		std::size_t bytes;
+	};
+
+	using Entries = std::list<Entry>;
+
+	struct Shard {
+		mutable std::mutex mutex;
+		Entries entries;
+		std::unordered_map<Key, typename Entries::iterator, Hash> index;
+		CacheStats stats{};
+		std::bitset<kMissesCount> misses;
+		std::size_t misses_count = 0;
+	};
+
+	// about a list node, a map node and the control block of the value
+	static constexpr std::size_t kEntryOverhead = 128;
+
+	// The hash of an integer may be the integer itself, so it is mixed
+	// by Fibonacci hashing, whose high bits are the well mixed ones
+	[[nodiscard]] static std::uint64_t mix(Key const &key) noexcept
+	{
+		constexpr std::uint64_t kGoldenRatio = 0x9E3779B97F4A7C15;
+		return Hash{}(key) * kGoldenRatio;
+	}
+
+	[[nodiscard]] static std::size_t getShardIndex(std::uint64_t hash) noexcept
+	{
+		return hash >> (64 - kShardBits);
+	}
+
+private:
+	std::size_t shard_budget_;
+	std::vector<Shard> shards_;
+};
+
+} // namespace utils
+
+#endif /* DDV_UTILS_LRU_CACHE_H_ */
@@ -0,0 +1,53 @@
+#ifndef DDV_UTILS_MAPPED_FILE_H_
+#define DDV_UTILS_MAPPED_FILE_H_ 1
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+
+namespace utils {
+
+/**
+ *	@brief	A file mapped into memory read-only.
+ *
+ *	The mapping is shared, so several processes mapping the same
+ *	file share its pages through the page cache.
+ */
+class MappedFile {
+public:
+	MappedFile() = default;
+	// throws std::system_error if the file cannot be mapped
+	explicit MappedFile(std::string const &path);
+	// maps a regular file opened for reading, the descriptor stays open
+	explicit MappedFile(int fd);
+	~MappedFile();
+
+	MappedFile(MappedFile &&) noexcept;
+	MappedFile &operator=(MappedFile &&) noexcept;
+
+	[[nodiscard]] char const *data() const noexcept
+	{
+		return data_;
+	}
+
+	[[nodiscard]] std::size_t size() const noexcept
+	{
+		return size_;
+	}
+
+	[[nodiscard]] std::string_view view() const noexcept
+	{
+		return {data_, size_};
+	}
+
+private:
+	void map(int fd, std::string const &name);
+
+private:
+	char const *data_ = nullptr;
+	std::size_t size_ = 0;
+};
+
+} // namespace utils
+
+#endif /* DDV_UTILS_MAPPED_FILE_H_ */
@@ -0,0 +1,87 @@
+#ifndef DDV_UTILS_MEMORY_H_
+#define DDV_UTILS_MEMORY_H_ 1
+
+#include <cstddef>
+#include <memory_resource>
+#include <string>
+
+#include <sys/resource.h>
+
+namespace utils {
+
+/**
+ *	@brief	A memory resource that counts the bytes passing through it.
+ *
+ *	All requests are forwarded to the upstream resource unchanged,
+ *	so the counters give the exact amount requested by the users
+ *	of the resource, not including the overhead of the upstream.
+ */
+class CountingResource final : public std::pmr::memory_resource {
+public:
+	explicit CountingResource(std::pmr::memory_resource *upstream) noexcept
+		: upstream_{upstream}
+	{
+	}
+
+	[[nodiscard]] std::size_t getBytes() const noexcept
+	{
+		return bytes_;
+	}
+
+	[[nodiscard]] std::size_t getPeakBytes() const noexcept
+	{
+		return peak_bytes_;
+	}
+
+private:
+	void *do_allocate(std::size_t bytes, std::size_t alignment) override
+	{
+		auto *p = upstream_->allocate(bytes, alignment);
+		bytes_ += bytes;
+		peak_bytes_ = bytes_ > peak_bytes_ ? bytes_ : peak_bytes_;
+		return p;
+	}
+
+	void do_deallocate(void *p, std::size_t bytes,
+		std::size_t alignment) override
+	{
+		upstream_->deallocate(p, bytes, alignment);
+		bytes_ -= bytes;
+	}
+
+	[[nodiscard]] bool do_is_equal(
+		std::pmr::memory_resource const &other) const noexcept override
+	{
+		return this == &other;
+	}
+
+private:
+	std::pmr::memory_resource *upstream_;
+	std::size_t bytes_{};
+	std::size_t peak_bytes_{};
+};
+
+/**
+ *	@brief	Number of bytes allocated by a string outside of itself.
+ */
+[[nodiscard]] inline std::size_t
+	getHeapBytes(std::string const &str) noexcept
+{
+	return str.capacity() > std::string{}.capacity() ?
+		str.capacity() + 1 :
+		0;
+}
+
+/**
+ *	@brief	Peak resident set size of the process in bytes.
+ */
+[[nodiscard]] inline std::size_t getPeakRss() noexcept
+{
+	rusage usage{};
+	getrusage(RUSAGE_SELF, &usage);
+	return static_cast<std::size_t>(usage.ru_maxrss) * 1024;
+}
+
+} // namespace utils
+
+#endif /* DDV_UTILS_MEMORY_H_ */
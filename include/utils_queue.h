@@ -0,0 +1,167 @@
+#ifndef DDV_UTILS_QUEUE_H_
+#define DDV_UTILS_QUEUE_H_ 1
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <utility>
+#include <vector>
+
+namespace utils {
+
+struct QueueStats {
+	std::size_t pushed;
+	// of the sizes seen by each push, for the mean
+	std::size_t total_size;
+	std::size_t max_size;
+	// times the producer waited for room, and how long
+	std::size_t full_waits;
+	std::chrono::nanoseconds full_wait_time;
+	// times the consumer waited for an item, and how long
+	std::size_t empty_waits;
+	std::chrono::nanoseconds empty_wait_time;
+};
+
+/**
+ *	@brief	A bounded queue between one producer and one consumer.
+ *
+ *	Items go round a ring of slots, the producer advancing the tail
+ *	and the consumer the head, so neither takes a lock. A producer
+ *	finding the ring full and a consumer finding it empty wait on
+ *	the index of the other side, which wakes them by advancing it.
+ *	Either side may close the queue: the producer when it is done,
+ *	after which the consumer takes what is left, or the consumer when
+ *	it gives up, after which pushes fail. Closing sets the top bit of both
+ *	indices, so that it wakes whoever waits.
+ */
+template <typename T>
+class SpscQueue {
+public:
+	using Clock = std::chrono::steady_clock;
+
+	// the capacity is rounded up to a power of two
+	explicit SpscQueue(std::size_t capacity)
+		: slots_(std::bit_ceil(std::max(capacity, std::size_t{1})))
+		, mask_{slots_.size() - 1}
+	{
+	}
+
+	// False if the queue is closed, the item is then left as it is
+	[[nodiscard]] bool push(T &&item)
+	{
+		auto tail = tail_.load(std::memory_order_relaxed) & kCountMask;
+		auto head = head_.load(std::memory_order_acquire);
+		if (tail - (head & kCountMask) > mask_ and not (head & kClosed)) {
+			auto start = Clock::now();
+			++producer_.full_waits;
+			do {
+				head_.wait(head, std::memory_order_acquire);
+				head = head_.load(std::memory_order_acquire);
+			} while (tail - (head & kCountMask) > mask_ and
+				not (head & kClosed));
+			producer_.full_wait_time += Clock::now() - start;
+		}
+		if (head & kClosed) {
+			return false;
+		}
+
+		slots_[tail & mask_].emplace(std::move(item));
+		auto size = tail + 1 - (head & kCountMask);
+		++producer_.pushed;
+		producer_.total_size += size;
+		producer_.max_size = std::max(producer_.max_size, size);
+		tail_.fetch_add(1, std::memory_order_release);
+		tail_.notify_one();
+		return true;
+	}
+
+	// Waits for an item, nothing once the queue is closed and empty
+	[[nodiscard]] std::optional<T> pop()
+	{
+		if (auto item = tryPop()) {
+			return item;
+		}
+		auto head = head_.load(std::memory_order_relaxed) & kCountMask;
+		auto tail = tail_.load(std::memory_order_acquire);
+		auto start = Clock::now();
+		++consumer_.empty_waits;
+		while ((tail & kCountMask) == head and not (tail & kClosed)) {
+			tail_.wait(tail, std::memory_order_acquire);
+			tail = tail_.load(std::memory_order_acquire);
+		}
+		consumer_.empty_wait_time += Clock::now() - start;
+		return tryPop();
+	}
+
+	// nothing if the queue is empty
+	[[nodiscard]] std::optional<T> tryPop()
+	{
+		auto head = head_.load(std::memory_order_relaxed) & kCountMask;
+		auto tail = tail_.load(std::memory_order_acquire);
+		if ((tail & kCountMask) == head) {
+			return std::nullopt;
+		}
+		auto &slot = slots_[head & mask_];
+		std::optional<T> item{std::move(slot)};
+		slot.reset();
+		head_.fetch_add(1, std::memory_order_release);
+		head_.notify_one();
+		return item;
+	}
+
+	void close() noexcept
+	{
+		head_.fetch_or(kClosed, std::memory_order_release);
+		tail_.fetch_or(kClosed, std::memory_order_release);
+		head_.notify_all();
+		tail_.notify_all();
+	}
+
+	// only once neither side uses the queue
+	[[nodiscard]] QueueStats getStats() const noexcept
+	{
+		return {
+			.pushed = producer_.pushed,
+			.total_size = producer_.total_size,
+			.max_size = producer_.max_size,
+			.full_waits = producer_.full_waits,
+			.full_wait_time = producer_.full_wait_time,
+			.empty_waits = consumer_.empty_waits,
+			.empty_wait_time = consumer_.empty_wait_time,
+		};
+	}
+
+private:
+	static constexpr std::uint64_t kClosed = std::uint64_t{1} << 63;
+	static constexpr std::uint64_t kCountMask = kClosed - 1;
+
+	struct ProducerStats {
+		std::size_t pushed = 0;
+		std::size_t total_size = 0;
+		std::size_t max_size = 0;
+		std::size_t full_waits = 0;
+		std::chrono::nanoseconds full_wait_time{};
+	};
+
+	struct ConsumerStats {
+		std::size_t empty_waits = 0;
+		std::chrono::nanoseconds empty_wait_time{};
+	};
+
+private:
+	std::vector<std::optional<T>> slots_;
+	std::uint64_t mask_;
+	// each side writes its own line only
+	alignas(64) std::atomic<std::uint64_t> head_{0};
+	ConsumerStats consumer_;
+	alignas(64) std::atomic<std::uint64_t> tail_{0};
+	ProducerStats producer_;
+};
+
+} // namespace utils
+
+#endif /* DDV_UTILS_QUEUE_H_ */
@@ -0,0 +1,201 @@
+#ifndef DDV_UTILS_SCHEDULER_H_
+#define DDV_UTILS_SCHEDULER_H_ 1
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <limits>
+#include <mutex>
+#include <optional>
+#include <utility>
+
+namespace utils {
+
+struct SchedulerClass {
+	// the share of the tasks taken from the class while others wait too
+	std::int64_t weight = 1;
+	// tasks pushed while as many wait are rejected
+	std::size_t max_queued = std::numeric_limits<std::size_t>::max();
+	// tasks that waited longer are handed out expired, none if zero
+	std::chrono::nanoseconds deadline{};
+	// tasks of the class running at once
+	std::size_t max_running = std::numeric_limits<std::size_t>::max();
+	// tasks of the class are started only while as many workers
+	// are left for the others
+	std::size_t workers_left = 0;
+};
+
+struct SchedulerStats {
+	std::size_t queued;
+	std::size_t started;
+	std::size_t rejected;
+	std::size_t expired;
+	// of the tasks started or expired
+	std::chrono::nanoseconds total_wait;
+	std::chrono::nanoseconds max_wait;
+};
+
+/**
+ *	@brief	Queues of tasks by class, taken in turn by weight.
+ *
+ *	Each class has a queue of its own, so that cheap tasks do not wait
+ *	behind costly ones. Of the classes with tasks that may run, the next
+ *	is picked by smooth weighted round robin, which gives each its share
+ *	of the tasks taken and spreads them evenly. Classes of costly tasks
+ *	may leave some workers to the others. A full queue rejects
+ *	tasks at once, and tasks that waited past the deadline are handed out
+ *	expired, for the caller to fail them fast.
+ */
+template <typename Task, std::size_t kClassesCount>
+class Scheduler {
+public:
+	using Classes = std::array<SchedulerClass, kClassesCount>;
+	using Stats = std::array<SchedulerStats, kClassesCount>;
+	using Clock = std::chrono::steady_clock;
+
+	struct Pick {
+		std::size_t class_index;
+		Task task;
+		bool is_expired;
+	};
+
+	Scheduler(Classes const &classes, std::size_t workers_count)
+		: classes_{classes}
+		, workers_count_{workers_count}
+	{
+	}
+
+	// The task is only moved from if it is taken.
+	// False if the queue of the class is full
+	[[nodiscard]] bool push(std::size_t class_index, Task &&task)
+	{
+		{
+			std::lock_guard lock{mutex_};
+			auto &queue = queues_[class_index];
+			if (queue.tasks.size() >= classes_[class_index].max_queued) {
+				++queue.stats.rejected;
+				return false;
+			}
+			queue.tasks.push_back({std::move(task), Clock::now()});
+		}
+		is_ready_.notify_one();
+		return true;
+	}
+
+	// Waits for a task, nothing once stopped. Called by the workers,
+	// of which there are no more than workers_count
+	// finish() is to be called with its class when it is done
+	[[nodiscard]] std::optional<Pick> pop()
+	{
+		std::unique_lock lock{mutex_};
+		std::size_t picked = 0;
+		is_ready_.wait(lock, [this, &picked] {
+			return is_stopped_ or pickClass(picked);
+		});
+		if (is_stopped_) {
+			return std::nullopt;
+		}
+
+		auto &queue = queues_[picked];
+		auto [task, queued_at] = std::move(queue.tasks.front());
+		queue.tasks.pop_front();
+		++queue.running;
+		++running_;
+		auto wait = std::chrono::duration_cast<std::chrono::nanoseconds>(
+			Clock::now() - queued_at);
+		auto deadline = classes_[picked].deadline;
+		bool is_expired = deadline.count() != 0 and wait > deadline;
+		++(is_expired ? queue.stats.expired : queue.stats.started);
+		queue.stats.total_wait += wait;
+		queue.stats.max_wait = std::max(queue.stats.max_wait, wait);
+		return Pick{picked, std::move(task), is_expired};
+	}
+
+	void finish(std::size_t class_index)
+	{
+		{
+			std::lock_guard lock{mutex_};
+			--queues_[class_index].running;
+			--running_;
+		}
+		is_ready_.notify_one();
+	}
+
+	// makes pop() return nothing, the tasks left are dropped
+	void stop()
+	{
+		{
+			std::lock_guard lock{mutex_};
+			is_stopped_ = true;
+		}
+		is_ready_.notify_all();
+	}
+
+	[[nodiscard]] Stats getStats() const
+	{
+		Stats stats{};
+		std::lock_guard lock{mutex_};
+		for (std::size_t i = 0; i != kClassesCount; ++i) {
+			stats[i] = queues_[i].stats;
+			stats[i].queued = queues_[i].tasks.size();
+		}
+		return stats;
+	}
+
+private:
+	struct Queued {
+		Task task;
+		Clock::time_point queued_at;
+	};
+
+	struct Queue {
+		std::deque<Queued> tasks;
+		std::size_t running = 0;
+		// the credit of smooth weighted round robin
+		std::int64_t current = 0;
+		SchedulerStats stats{};
+	};
+
+	// Each class that may run a task gains its weight, and the one with
+	// the most credit is picked and pays for all of them
+	[[nodiscard]] bool pickClass(std::size_t &picked) noexcept
+	{
+		std::int64_t total = 0;
+		bool is_found = false;
+		for (std::size_t i = 0; i != kClassesCount; ++i) {
+			auto &queue = queues_[i];
+			if (queue.tasks.empty() or
+					queue.running >= classes_[i].max_running or
+					running_ + classes_[i].workers_left >= workers_count_) {
+				continue;
+			}
+			queue.current += classes_[i].weight;
+			total += classes_[i].weight;
+			if (not is_found or queue.current > queues_[picked].current) {
+				picked = i;
+				is_found = true;
+			}
+		}
+		if (is_found) {
+			queues_[picked].current -= total;
+		}
+		return is_found;
+	}
+
+private:
+	Classes classes_;
+	std::size_t workers_count_;
+	mutable std::mutex mutex_;
+	std::condition_variable is_ready_;
+	std::array<Queue, kClassesCount> queues_;
+	std::size_t running_ = 0;
+	bool is_stopped_ = false;
+};
+
+} // namespace utils
+
+#endif /* DDV_UTILS_SCHEDULER_H_ */
@@ -0,0 +1,26 @@
+#ifndef DDV_UTILS_SOCKET_H_
+#define DDV_UTILS_SOCKET_H_ 1
+
+#include <string>
+
+#include "utils_io.h"
+
+namespace utils {
+
+// An address is either tcp:<port>, on the loopback interface,
+// or the path of a Unix domain socket
+
+// A non-blocking socket listening at the address. A socket file left
+// at the path is replaced. Throws std::system_error on failure
+[[nodiscard]] FileDescriptor listenAt(std::string const &address);
+
+// A blocking socket connected to the address.
+// Throws std::system_error on failure
+[[nodiscard]] FileDescriptor connectTo(std::string const &address);
+
+// Removes the socket file of a Unix domain socket address
+void unlinkAddress(std::string const &address) noexcept;
+
+} // namespace utils
+
+#endif /* DDV_UTILS_SOCKET_H_ */
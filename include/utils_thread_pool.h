@@ -0,0 +1,61 @@
+#ifndef DDV_UTILS_THREAD_POOL_H_
+#define DDV_UTILS_THREAD_POOL_H_ 1
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace utils {
+
+/**
+ *	@brief	A fixed set of threads running tasks from a common queue.
+ *
+ *	Work is handed out in chunks through parallelFor, whose caller takes
+ *	chunks along with the threads, so it never waits for a chunk that
+ *	nobody runs. That makes it safe to call parallelFor from a task and
+ *	from a pool without threads.
+ */
+class ThreadPool {
+public:
+	using Body = std::function<void(std::size_t first, std::size_t last)>;
+
+	explicit ThreadPool(std::size_t threads_count);
+	ThreadPool(ThreadPool const &) = delete;
+	ThreadPool &operator=(ThreadPool const &) = delete;
+	~ThreadPool();
+
+	// the number of threads besides the caller
+	[[nodiscard]] std::size_t size() const noexcept;
+
+	// Calls body for the chunks of [0, count) of at most chunk_size
+	// indices and returns when all of them are done. Rethrows the first
+	// exception thrown by body, the chunks not started by then are skipped
+	void parallelFor(std::size_t count, std::size_t chunk_size,
+		Body const &body);
+
+private:
+	void work();
+
+private:
+	std::mutex mutex_;
+	std::condition_variable has_tasks_;
+	std::deque<std::function<void()>> tasks_;
+	bool is_stopped_ = false;
+	std::vector<std::thread> threads_;
+};
+
+/**
+ *	@brief	The pool shared by the whole process.
+ *
+ *	Has a thread less than the hardware runs at once,
+ *	the thread calling parallelFor being the last one.
+ */
+[[nodiscard]] ThreadPool &getThreadPool();
+
+} // namespace utils
+
+#endif /* DDV_UTILS_THREAD_POOL_H_ */
@@ -0,0 +1,390 @@
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <exception>
+#include <filesystem>
+#include <functional>
+#include <future>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <type_traits>
+#include <utility>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "batch.h"
+#include "description.h"
+#include "json_view.h"
+#include "msgpack.h"
+#include "request.h"
+#include "transport_directory.h"
+#include "utils_io.h"
+#include "utils_thread_pool.h"
+
+namespace batch {
+
+namespace {
+
+// A directory with the tag of its routes in the cache shared by all
+struct Built {
+	transport::TransportDirectory directory;
+	std::uint32_t cache_tag;
+};
+
+/**
+ *	@brief	Directories by the config they are built from.
+ *
+ *	Directories are found by the hash of the texts of the config,
+ *	and each keeps the texts it is built from, so that a config whose
+ *	hash collides with that of another one is built apart. The first
+ *	input with a config builds the directory, and those with the same
+ *	config that come meanwhile wait for it. Once built, the least
+ *	recently used others are dropped while the directories take more
+ *	memory than the budget, the inputs using them finishing with them.
+ *	A directory that fails to build is not kept, the inputs waiting
+ *	for it failing too.
+ */
+class Builds {
+public:
+	using Build = std::function<transport::TransportDirectory()>;
+	using Texts = std::array<std::string_view, 3>;
+
+	explicit Builds(std::size_t memory_budget) noexcept
+		: memory_budget_{memory_budget}
+	{
+	}
+
+	[[nodiscard]] std::shared_ptr<Built const> get(std::uint64_t hash,
+		Texts const &texts, Build const &build);
+
+	[[nodiscard]] std::size_t getBuildsCount() const noexcept
+	{
+		return builds_count_.load(std::memory_order_relaxed);
+	}
+
+	[[nodiscard]] std::size_t getEvictionsCount() const noexcept
+	{
+		return evictions_count_.load(std::memory_order_relaxed);
+	}
+
+private:
+	struct Entry {
+		std::shared_future<std::shared_ptr<Built const>> built;
+		std::array<std::string, 3> texts;
+		std::uint64_t last_used = 0;
+		// of the directory and the texts, zero until it is built
+		std::size_t bytes = 0;
+	};
+	using Entries = std::multimap<std::uint64_t, Entry>;
+
+	// drops entries other than the one kept while over the budget
+	void evict(Entries::const_iterator kept);
+
+private:
+	std::size_t memory_budget_;
+	std::mutex mutex_;
+	Entries entries_;
+	std::uint64_t uses_count_ = 0;
+	std::uint32_t next_tag_ = 0;
+	std::atomic<std::size_t> builds_count_{0};
+	std::atomic<std::size_t> evictions_count_{0};
+};
+
+// The token indexes of json inputs, kept for the inputs to come
+class Indexes {
+public:
+	[[nodiscard]] std::vector<std::uint32_t> take();
+	void give(std::vector<std::uint32_t> &&);
+
+private:
+	std::mutex mutex_;
+	std::vector<std::vector<std::uint32_t>> free_;
+};
+
+template <typename Writer>
+struct Context {
+	Settings const &settings;
+	Builds builds;
+	request::RouteCache<Writer> route_cache;
+	Indexes indexes;
+};
+
+template <typename Writer>
+[[nodiscard]] Stats processAll(std::vector<std::string> const &inputs,
+	Settings const &);
+
+template <typename Writer>
+void processFile(std::string const &input, Context<Writer> &);
+
+template <typename Reader, typename Writer>
+void answer(Reader &reader, std::string const &input, Context<Writer> &);
+
+// throws std::system_error on failure
+[[nodiscard]] utils::FileDescriptor openOutput(std::string const &path);
+
+void log(std::string const &message) noexcept;
+
+} // namespace batch::anonymous
+
+std::vector<std::string> listInputs(std::string const &path)
+{
+	std::vector<std::string> inputs;
+	if (std::filesystem::is_directory(path)) {
+		for (auto const &file : std::filesystem::directory_iterator{path}) {
+			if (file.is_regular_file() and
+					file.path().stem().extension() != ".out") {
+				inputs.push_back(file.path().string());
+			}
+		}
+		std::sort(inputs.begin(), inputs.end());
+		return inputs;
+	}
+
+	auto const buffer = json::Buffer::map(path);
+	auto list = buffer.view();
+	while (not list.empty()) {
+		auto end = std::min(list.find('\n'), list.size());
+		auto line = list.substr(0, end);
+		list.remove_prefix(std::min(end + 1, list.size()));
+		auto first = line.find_first_not_of(" \t\r");
+		if (first != std::string_view::npos) {
+			auto last = line.find_last_not_of(" \t\r");
+			inputs.emplace_back(line.substr(first, last + 1 - first));
+		}
+	}
+	return inputs;
+}
+
+std::string getOutputPath(std::string const &input)
+{
+	std::filesystem::path path{input};
+	auto extension = path.extension().string();
+	path.replace_extension();
+	return path.string() + ".out" + extension;
+}
+
+Stats processFiles(std::vector<std::string> const &inputs,
+	Settings const &settings)
+{
+	if (settings.is_msgpack) {
+		return processAll<msgpack::Writer>(inputs, settings);
+	}
+	return processAll<json::Writer>(inputs, settings);
+}
+
+json::Object describeStats(Stats const &stats)
+{
+	return {
+		{"builds", static_cast<json::Int>(stats.builds_count)},
+		{"evictions", static_cast<json::Int>(stats.evictions_count)},
+		{"failures", static_cast<json::Int>(stats.failures_count)},
+		{"files", static_cast<json::Int>(stats.files_count)},
+	};
+}
+
+namespace {
+
+// An entry is found by its hash and then by its texts,
+// and it is not dropped while it is being built
+std::shared_ptr<Built const> Builds::get(std::uint64_t hash,
+	Texts const &texts, Build const &build)
+{
+	std::promise<std::shared_ptr<Built const>> building;
+	std::shared_future<std::shared_ptr<Built const>> built;
+	std::uint32_t cache_tag = 0;
+	Entries::iterator it;
+	{
+		std::lock_guard lock{mutex_};
+		auto [first, last] = entries_.equal_range(hash);
+		it = std::find_if(first, last, [&texts](auto const &entry) {
+			return std::equal(texts.begin(), texts.end(),
+				entry.second.texts.begin());
+		});
+		if (it != last) {
+			built = it->second.built;
+		} else {
+			it = entries_.emplace(hash, Entry{
+				.built = building.get_future().share(),
+				.texts = {
+					std::string{texts[0]},
+					std::string{texts[1]},
+					std::string{texts[2]},
+				},
+			});
+			cache_tag = next_tag_++;
+		}
+		it->second.last_used = ++uses_count_;
+	}
+	if (built.valid()) {
+		return built.get();
+	}
+
+	std::shared_ptr<Built const> directory;
+	try {
+		directory = std::make_shared<Built const>(Built{build(), cache_tag});
+	} catch (...) {
+		{
+			std::lock_guard lock{mutex_};
+			entries_.erase(it);
+		}
+		building.set_exception(std::current_exception());
+		throw;
+	}
+	builds_count_.fetch_add(1, std::memory_order_relaxed);
+	building.set_value(directory);
+	auto bytes = directory->directory.getMemoryUsage().total;
+	for (auto const &text : texts) {
+		bytes += text.size();
+	}
+	std::lock_guard lock{mutex_};
+	it->second.bytes = bytes;
+	evict(it);
+	return directory;
+}
+
+// Entries still being built are neither counted nor dropped
+void Builds::evict(Entries::const_iterator kept)
+{
+	for (;;) {
+		std::size_t total = 0;
+		auto oldest = entries_.end();
+		for (auto it = entries_.begin(); it != entries_.end(); ++it) {
+			total += it->second.bytes;
+			if (it != kept and it->second.bytes != 0 and
+					(oldest == entries_.end() or
+						it->second.last_used < oldest->second.last_used)) {
+				oldest = it;
+			}
+		}
+		if (total <= memory_budget_ or oldest == entries_.end()) {
+			return;
+		}
+		entries_.erase(oldest);
+		evictions_count_.fetch_add(1, std::memory_order_relaxed);
+	}
+}
+
+std::vector<std::uint32_t> Indexes::take()
+{
+	std::lock_guard lock{mutex_};
+	if (free_.empty()) {
+		return {};
+	}
+	auto index = std::move(free_.back());
+	free_.pop_back();
+	return index;
+}
+
+void Indexes::give(std::vector<std::uint32_t> &&index)
+{
+	std::lock_guard lock{mutex_};
+	free_.push_back(std::move(index));
+}
+
+// An input per task, as inputs differ in size by far
+template <typename Writer>
+Stats processAll(std::vector<std::string> const &inputs,
+	Settings const &settings)
+{
+	Context<Writer> context{
+		.settings = settings,
+		.builds = Builds{settings.memory_budget},
+		.route_cache = request::RouteCache<Writer>{settings.route_cache_size},
+		.indexes = {},
+	};
+	std::atomic<std::size_t> failures_count{0};
+	utils::getThreadPool().parallelFor(inputs.size(), 1,
+		[&](std::size_t first, std::size_t last) {
+			for (auto i = first; i != last; ++i) {
+				try {
+					processFile(inputs[i], context);
+				} catch (std::exception const &e) {
+					failures_count.fetch_add(1, std::memory_order_relaxed);
+					log(inputs[i] + ": " + e.what() + '\n');
+				}
+			}
+		}
+	);
+	return {
+		.files_count = inputs.size(),
+		.failures_count = failures_count.load(),
+		.builds_count = context.builds.getBuildsCount(),
+		.evictions_count = context.builds.getEvictionsCount(),
+		.route_cache = context.route_cache.getStats(),
+	};
+}
+
+template <typename Writer>
+void processFile(std::string const &input, Context<Writer> &context)
+{
+	auto const buffer = json::Buffer::map(input);
+	if constexpr (std::is_same_v<Writer, msgpack::Writer>) {
+		msgpack::Reader reader{buffer.view()};
+		answer(reader, input, context);
+	} else {
+		json::Reader reader{buffer.view(), context.indexes.take()};
+		answer(reader, input, context);
+		context.indexes.give(std::move(reader).releaseIndex());
+	}
+}
+
+// The requests are read before waiting for the directory, and the output
+// is only created once both are there, so an input that fails has none
+template <typename Reader, typename Writer>
+void answer(Reader &reader, std::string const &input,
+	Context<Writer> &context)
+{
+	auto outline = description::outlineInput(reader);
+	auto requests_reader = reader.fork(outline.requests);
+	auto requests = request::readRequests(requests_reader);
+	auto built = context.builds.get(outline.config_hash, outline.config_texts,
+		[&reader] {
+			auto config_reader = reader.fork(0);
+			return transport::TransportDirectory{
+				description::readConfig(config_reader)
+			};
+		});
+
+	auto output = openOutput(getOutputPath(input));
+	auto process = [&](Writer &writer) {
+		request::processAll(requests, built->directory, writer,
+			&context.route_cache, built->cache_tag);
+		writer.flush();
+	};
+	if constexpr (std::is_same_v<Writer, msgpack::Writer>) {
+		msgpack::Writer writer{output.get()};
+		process(writer);
+	} else {
+		json::Writer writer{output.get(), context.settings.doubles};
+		process(writer);
+	}
+}
+
+utils::FileDescriptor openOutput(std::string const &path)
+{
+	auto fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC,
+		0644);
+	if (fd == -1) {
+		throw std::system_error{errno, std::generic_category(), path};
+	}
+	return utils::FileDescriptor{fd};
+}
+
+void log(std::string const &message) noexcept
+{
+	try {
+		utils::writeAll(STDERR_FILENO, message);
+	} catch (std::system_error const &) {
+	}
+}
+
+} // namespace batch::anonymous
+
+} // namespace batch
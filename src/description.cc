@@ -1,18 +1,28 @@
+#include <algorithm>
+#include <array>
+#include <functional>
+#include <optional>
+#include <stdexcept>
+#include <string>
 #include <string_view>
 #include <unordered_map>
+#include <utility>
+#include <vector>
 
 #include "description.h"
+#include "msgpack.h"
+#include "utils_thread_pool.h"
 
 using namespace transport::config;
 
-using json::Array;
-using json::Object;
+using json::view::Array;
+using json::view::Object;
 
 namespace description {
 
 namespace {
 
-[[nodiscard]] svg::Color	parseColor(json::Element const &);
+[[nodiscard]] svg::Color	parseColor(json::view::Element const &);
 [[nodiscard]] Distances		parseDistances(Object const &);
 [[nodiscard]] Item			parseItem(Object const &);
 [[nodiscard]] Items			parseItems(Array const &);
@@ -21,13 +31,34 @@ namespace {
 [[nodiscard]] util::point	parsePoint(Array const &);
 [[nodiscard]] Route			parseRoute(Array const &, bool is_roundtrip);
 
+template <typename Reader>
+[[nodiscard]] Distances		readDistances(Reader &);
+template <typename Reader>
+[[nodiscard]] Item			readItem(Reader &);
+template <typename Reader>
+[[nodiscard]] Items			readItems(Reader &);
+template <typename Reader>
+[[nodiscard]] Route			readRoute(Reader &);
+
+template <typename Reader>
+bool readSections(Reader &,
+	std::function<void(Config &&)> const &on_config,
+	std::function<void(Reader &)> const &read_requests);
+
+void require(bool is_read, char const *key)
+{
+	if (not is_read) {
+		throw std::out_of_range{std::string{"description: no "} + key};
+	}
+}
+
 } // namespace description::anonymous
 
 Bus parseBus(Object const &node)
 {
 	bool is_roundtrip = node.at("is_roundtrip").asBoolean();
 	return {
-		.name = node.at("name").asString(),
+		.name = node.at("name").asString().decode(),
 		.route = parseRoute(
 			node.at("stops").asArray(),
 			is_roundtrip
@@ -39,7 +70,7 @@ Bus parseBus(Object const &node)
 Stop parseStop(Object const &node)
 {
 	return {
-		.name = node.at("name").asString(),
+		.name = node.at("name").asString().decode(),
 		.coords = {
 			.x = node.at("latitude").asDouble(),
 			.y = node.at("longitude").asDouble(),
@@ -98,12 +129,89 @@ Config parseConfig(Object const &node)
 	};
 }
 
+template <typename Reader>
+void readInput(Reader &reader,
+	std::function<void(Config &&)> const &on_config,
+	std::function<void(std::type_identity_t<Reader> &)> const &read_requests)
+{
+	require(readSections(reader, on_config, read_requests), "stat_requests");
+}
+
+template <typename Reader>
+Config readConfig(Reader &reader)
+{
+	std::optional<Config> config;
+	readSections<Reader>(
+		reader,
+		[&config](Config &&read) noexcept {
+			config = std::move(read);
+		},
+		[](Reader &requests) {
+			requests.skip();
+		}
+	);
+	return std::move(*config);
+}
+
+template void readInput(json::Reader &,
+	std::function<void(Config &&)> const &,
+	std::function<void(json::Reader &)> const &);
+template void readInput(msgpack::Reader &,
+	std::function<void(Config &&)> const &,
+	std::function<void(msgpack::Reader &)> const &);
+
+template Config readConfig(json::Reader &);
+template Config readConfig(msgpack::Reader &);
+
+// The sections are hashed in a fixed order, wherever they are
+template <typename Reader>
+Outline<Reader> outlineInput(Reader &reader)
+{
+	constexpr std::array<std::string_view, 3> kConfigKeys = {
+		"base_requests", "routing_settings", "render_settings",
+	};
+	std::array<std::optional<std::string_view>, kConfigKeys.size()> texts;
+	std::optional<typename Reader::Position> requests;
+	reader.enterObject();
+	for (json::view::String key; reader.nextMember(key); ) {
+		auto it = std::find_if(kConfigKeys.begin(), kConfigKeys.end(),
+			[&key](std::string_view config_key) {
+				return key == config_key;
+			});
+		if (it != kConfigKeys.end()) {
+			texts[static_cast<std::size_t>(it - kConfigKeys.begin())] =
+				reader.readRaw();
+		} else if (key == "stat_requests") {
+			requests = reader.tell();
+			reader.skip();
+		} else {
+			reader.skip();
+		}
+	}
+	reader.finish();
+
+	constexpr std::uint64_t kGoldenRatio = 0x9E3779B97F4A7C15;
+	std::uint64_t hash = 0;
+	std::array<std::string_view, kConfigKeys.size()> config_texts;
+	for (std::size_t i = 0; i != kConfigKeys.size(); ++i) {
+		require(texts[i].has_value(), kConfigKeys[i].data());
+		hash ^= std::hash<std::string_view>{}(*texts[i]) + kGoldenRatio +
+			(hash << 6) + (hash >> 2);
+		config_texts[i] = *texts[i];
+	}
+	require(requests.has_value(), "stat_requests");
+	return {hash, config_texts, *requests};
+}
+
+template Outline<json::Reader> outlineInput(json::Reader &);
+template Outline<msgpack::Reader> outlineInput(msgpack::Reader &);
+
 namespace {
 
-svg::Color parseColor(json::Element const &node)
+svg::Color parseColor(json::view::Element const &node)
 {
-	if (auto str = std::get_if<std::string>(&node.getBase())) {
-		return *str;
+	if (auto str = std::get_if<json::view::String>(&node.getBase())) {
+		return str->decode();
 	}
 	auto const &nodes = std::get<Array>(node.getBase());
 	if (nodes.size() == 3) {
@@ -126,7 +234,7 @@ Distances parseDistances(Object const &nodes)
 	Distances distances;
 	distances.reserve(nodes.size());
 	for (auto const &[stop, distance] : nodes) {
-		distances.emplace_back(stop, distance.asDouble());
+		distances.emplace_back(std::string{stop}, distance.asDouble());
 	}
 	return distances;
 }
@@ -138,16 +246,19 @@ Item parseItem(Object const &node)
 		{"Bus",		[](Object const &n) { return Item{parseBus(n)}; }},
 		{"Stop",	[](Object const &n) { return Item{parseStop(n)}; }},
 	};
-	return parser.at(node.at("type").asString())(node);
+	return parser.at(node.at("type").asString().decode())(node);
 }
 
 Items parseItems(Array const &nodes)
 {
-	Items items;
-	items.reserve(nodes.size());
-	for (auto const &node : nodes) {
-		items.emplace_back(parseItem(node.asObject()));
-	}
+	constexpr std::size_t kChunkSize = 256;
+	Items items(nodes.size());
+	utils::getThreadPool().parallelFor(nodes.size(), kChunkSize,
+		[&](std::size_t first, std::size_t last) {
+			for (auto i = first; i != last; ++i) {
+				items[i] = parseItem(nodes[i].asObject());
+			}
+		});
 	return items;
 }
 
@@ -156,7 +267,7 @@ Layers parseLayers(Array const &nodes)
 	Layers layers;
 	layers.reserve(nodes.size());
 	for (auto const &node : nodes) {
-		layers.push_back(node.asString());
+		layers.push_back(node.asString().decode());
 	}
 	return layers;
 }
@@ -184,7 +295,7 @@ Route parseRoute(Array const &nodes, bool is_roundtrip)
 	Route stops;
 	stops.reserve(is_roundtrip ? nodes.size() : 2 * nodes.size() - 1);
 	for (auto const &stop : nodes) {
-		stops.push_back(stop.asString());
+		stops.push_back(stop.asString().decode());
 	}
 	if (not is_roundtrip) {
 		for (auto i = nodes.size() - 1; i-- != 0; ) {
@@ -194,6 +305,166 @@ Route parseRoute(Array const &nodes, bool is_roundtrip)
 	return stops;
 }
 
+template <typename Reader>
+Distances readDistances(Reader &reader)
+{
+	Distances distances;
+	reader.enterObject();
+	for (json::view::String stop; reader.nextMember(stop); ) {
+		distances.emplace_back(stop.decode(), reader.readDouble());
+	}
+	return distances;
+}
+
+// The keys of an item may come in any order, so the fields are
+// collected first and the type is only looked at in the end
+template <typename Reader>
+Item readItem(Reader &reader)
+{
+	json::view::String type;
+	std::string name;
+	util::point coords{};
+	Distances distances;
+	Route route;
+	bool is_roundtrip = false;
+	reader.enterObject();
+	for (json::view::String key; reader.nextMember(key); ) {
+		if (key == "type") {
+			type = reader.readString();
+		} else if (key == "name") {
+			name = reader.readString().decode();
+		} else if (key == "latitude") {
+			coords.x = reader.readDouble();
+		} else if (key == "longitude") {
+			coords.y = reader.readDouble();
+		} else if (key == "road_distances") {
+			distances = readDistances(reader);
+		} else if (key == "stops") {
+			route = readRoute(reader);
+		} else if (key == "is_roundtrip") {
+			is_roundtrip = reader.readBoolean();
+		} else {
+			reader.skip();
+		}
+	}
+	if (type == "Stop") {
+		return Stop{
+			.name = std::move(name),
+			.coords = coords,
+			.distances = std::move(distances),
+		};
+	}
+	if (type != "Bus") {
+		throw std::out_of_range{"description: unknown item type"};
+	}
+	if (not is_roundtrip and not route.empty()) {
+		route.reserve(2 * route.size() - 1);
+		for (auto i = route.size() - 1; i-- != 0; ) {
+			route.push_back(route[i]);
+		}
+	}
+	return Bus{
+		.name = std::move(name),
+		.route = std::move(route),
+		.is_roundtrip = is_roundtrip,
+	};
+}
+
+// The items are only skipped over in order, and then read in chunks
+// in parallel, each by a reader of its own. Without threads to run
+// the chunks, skipping would only add a pass, so they are read in place
+template <typename Reader>
+Items readItems(Reader &reader)
+{
+	constexpr std::size_t kChunkSize = 256;
+	auto &pool = utils::getThreadPool();
+	reader.enterArray();
+	if (pool.size() == 0) {
+		Items items;
+		while (reader.nextElement()) {
+			items.push_back(readItem(reader));
+		}
+		return items;
+	}
+	std::vector<typename Reader::Position> positions;
+	while (reader.nextElement()) {
+		positions.push_back(reader.tell());
+		reader.skip();
+	}
+	Items items(positions.size());
+	pool.parallelFor(positions.size(), kChunkSize,
+		[&](std::size_t first, std::size_t last) {
+			for (auto i = first; i != last; ++i) {
+				auto item_reader = reader.fork(positions[i]);
+				items[i] = readItem(item_reader);
+			}
+		});
+	return items;
+}
+
+template <typename Reader>
+Route readRoute(Reader &reader)
+{
+	Route stops;
+	reader.enterArray();
+	while (reader.nextElement()) {
+		stops.push_back(reader.readString().decode());
+	}
+	return stops;
+}
+
+// Reads everything but checks only the config, returns whether
+// the requests were read. Without on_config the config is skipped
+template <typename Reader>
+bool readSections(Reader &reader,
+	std::function<void(Config &&)> const &on_config,
+	std::function<void(Reader &)> const &read_requests)
+{
+	bool is_config_needed = static_cast<bool>(on_config);
+	std::optional<Items> items;
+	std::optional<RoutingSettings> routing_settings;
+	std::optional<RenderSettings> render_settings;
+	bool is_config_passed = false;
+	bool are_requests_read = false;
+	reader.enterObject();
+	for (json::view::String key; reader.nextMember(key); ) {
+		if (not is_config_needed and key != "stat_requests") {
+			reader.skip();
+		} else if (key == "base_requests") {
+			items = readItems(reader);
+		} else if (key == "routing_settings") {
+			routing_settings = parseRoutingSettings(
+				reader.readDocument().getRoot().asObject()
+			);
+		} else if (key == "render_settings") {
+			render_settings = parseRenderSettings(
+				reader.readDocument().getRoot().asObject()
+			);
+		} else if (key == "stat_requests") {
+			read_requests(reader);
+			are_requests_read = true;
+		} else {
+			reader.skip();
+		}
+		if (not is_config_passed and items and routing_settings and
+				render_settings) {
+			is_config_passed = true;
+			on_config({
+				.items = std::move(*items),
+				.routing_settings = *routing_settings,
+				.render_settings = std::move(*render_settings),
+			});
+		}
+	}
+	reader.finish();
+	if (is_config_needed) {
+		require(items.has_value(), "base_requests");
+		require(routing_settings.has_value(), "routing_settings");
+		require(render_settings.has_value(), "render_settings");
+	}
+	return are_requests_read;
+}
+
 } // namespace description::anonymous
 
 } // namespace description
@@ -1,8 +1,16 @@
-#include <iomanip>
+#include <charconv>
+#include <limits>
+#include <stdexcept>
+#include <system_error>
 #include <utility>
 
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
 #include "json.h"
 #include "util.h"
+#include "utils_memory.h"
 
 namespace json {
 
@@ -14,8 +22,159 @@ namespace {
 [[nodiscard]] Element readObject(std::istream &);
 [[nodiscard]] Element readString(std::istream &);
 
+// The first character that needs an escape, or end
+[[nodiscard]] char const *findEscape(char const *, char const *) noexcept;
+void appendEscape(std::string &, char);
+
 } // namespace json::anonymous
 
+void appendQuoted(std::string &out, std::string_view str)
+{
+	out.reserve(out.size() + str.size() + 2);
+	out.push_back('"');
+	auto const *pos = str.data();
+	auto const *end = pos + str.size();
+	for (;;) {
+		auto const *special = findEscape(pos, end);
+		out.append(pos, special);
+		if (special == end) {
+			break;
+		}
+		appendEscape(out, *special);
+		pos = special + 1;
+	}
+	out.push_back('"');
+}
+
+// Clinger's fast path: when the digits fit in the 53 bits of a double
+// and the power of ten is at most 10^22, both are exact and a single
+// multiplication or division rounds correctly. Anything else is left
+// to std::from_chars
+std::optional<Number> parseNumber(std::string_view text) noexcept
+{
+	constexpr double kPowersOfTen[] = {
+		1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+		1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22,
+	};
+	constexpr int kMaxDigits = 19;
+	constexpr std::uint64_t kMaxExactMantissa = std::uint64_t{1} << 53;
+	auto const isDigit = [](char c) noexcept {
+		return c >= '0' and c <= '9';
+	};
+
+	auto const *pos = text.data();
+	auto const *end = pos + text.size();
+	bool is_negative = pos != end and *pos == '-';
+	if (is_negative) {
+		++pos;
+	}
+	if (pos == end or not isDigit(*pos)) {
+		return std::nullopt;
+	}
+	// no leading zeros
+	if (*pos == '0' and pos + 1 != end and isDigit(pos[1])) {
+		return std::nullopt;
+	}
+	std::uint64_t mantissa{};
+	int digits{};
+	int exponent{};
+	for (; pos != end and isDigit(*pos); ++pos, ++digits) {
+		mantissa = mantissa * 10 + static_cast<unsigned>(*pos - '0');
+	}
+	bool is_integer = true;
+	if (pos != end and *pos == '.') {
+		is_integer = false;
+		auto const *fraction = ++pos;
+		for (; pos != end and isDigit(*pos); ++pos, ++digits) {
+			mantissa = mantissa * 10 + static_cast<unsigned>(*pos - '0');
+		}
+		if (pos == fraction) {
+			return std::nullopt;
+		}
+		exponent -= static_cast<int>(pos - fraction);
+	}
+	if (pos != end and (*pos == 'e' or *pos == 'E')) {
+		is_integer = false;
+		++pos;
+		bool is_exponent_negative = pos != end and *pos == '-';
+		if (pos != end and (*pos == '-' or *pos == '+')) {
+			++pos;
+		}
+		if (pos == end or not isDigit(*pos)) {
+			return std::nullopt;
+		}
+		int value{};
+		for (; pos != end and isDigit(*pos); ++pos) {
+			if (value < 100'000) {
+				value = value * 10 + (*pos - '0');
+			}
+		}
+		exponent += is_exponent_negative ? -value : value;
+	}
+	if (pos != end) {
+		return std::nullopt;
+	}
+
+	if (digits <= kMaxDigits) {
+		if (is_integer and mantissa <=
+				static_cast<std::uint64_t>(std::numeric_limits<Int>::max())) {
+			auto integer = static_cast<Int>(mantissa);
+			return is_negative ? -integer : integer;
+		}
+		if (not is_integer and mantissa <= kMaxExactMantissa and
+				exponent >= -22 and exponent <= 22) {
+			auto number = static_cast<double>(mantissa);
+			if (exponent < 0) {
+				number /= kPowersOfTen[-exponent];
+			} else {
+				number *= kPowersOfTen[exponent];
+			}
+			return is_negative ? -number : number;
+		}
+	}
+	double number;
+	auto [last, error] = std::from_chars(text.data(), end, number);
+	if (error != std::errc{} or last != end) {
+		return std::nullopt;
+	}
+	return number;
+}
+
+// Exact for libstdc++: a node of std::map holds the colour and
+// three links of a red-black tree followed by the value
+std::size_t computeHeapUsage(Element const &element) noexcept
+{
+	constexpr std::size_t kMapNodeHeader = 4 * sizeof(void *);
+	return std::visit(util::overloaded{
+		[](Object const &object) noexcept {
+			std::size_t bytes{};
+			for (auto const &[key, value] : object) {
+				bytes += kMapNodeHeader + sizeof(Object::value_type) +
+					utils::getHeapBytes(key) + computeHeapUsage(value);
+			}
+			return bytes;
+		},
+		[](Array const &array) noexcept {
+			auto bytes = array.capacity() * sizeof(Element);
+			for (auto const &value : array) {
+				bytes += computeHeapUsage(value);
+			}
+			return bytes;
+		},
+		[](std::string const &string) noexcept {
+			return utils::getHeapBytes(string);
+		},
+		[](auto) noexcept {
+			return std::size_t{};
+		},
+	}, element.getBase());
+}
+
+std::size_t computeMemoryUsage(Document const &document) noexcept
+{
+	return sizeof(Document) + computeHeapUsage(document.getRoot());
+}
+
 Element readElement(std::istream &is)
 {
 	char c;
@@ -88,7 +247,9 @@ void writeValue(Array const &array, std::ostream &os)
 
 void writeValue(std::string const &string, std::ostream &os)
 {
-	os << std::quoted(string);
+	std::string quoted;
+	appendQuoted(quoted, string);
+	os << quoted;
 }
 
 void writeValue(bool boolean, std::ostream &os)
@@ -134,27 +295,18 @@ Element readBoolean(std::istream &is)
 
 Element readNumber(std::istream &is)
 {
-	bool is_negative = false;
-	if (is.peek() == '-') {
-		is_negative = true;
-		is.get();
-	}
-	Int integer{};
-	while (std::isdigit(is.peek())) {
-		integer *= 10;
-		integer += is.get() - '0';
+	std::string text;
+	for (auto c = is.peek(); std::isdigit(c) or c == '-' or c == '+' or
+			c == '.' or c == 'e' or c == 'E'; c = is.peek()) {
+		text.push_back(static_cast<char>(is.get()));
 	}
-	if (is.peek() != '.') {
-		return is_negative ? -integer : integer;
+	auto number = parseNumber(text);
+	if (not number) {
+		throw std::invalid_argument{"json: invalid number " + text};
 	}
-	is.get();
-	auto number = static_cast<double>(integer);
-	auto multiplier = 0.1;
-	while (std::isdigit(is.peek())) {
-		number += multiplier * (is.get() - '0');
-		multiplier /= 10;
-	}
-	return is_negative ? -number : number;
+	return std::visit([](auto value) noexcept {
+		return Element{value};
+	}, *number);
 }
 
 Element readObject(std::istream &is)
@@ -181,6 +333,74 @@ Element readString(std::istream &is)
 	return element;
 }
 
+[[nodiscard]] bool needsEscape(char c) noexcept
+{
+	return static_cast<unsigned char>(c) < 0x20 or c == '"' or c == '\\';
+}
+
+[[nodiscard]] char const *findEscape(char const *pos, char const *end) noexcept
+{
+#if defined(__x86_64__)
+	auto const quote = _mm_set1_epi8('"');
+	auto const backslash = _mm_set1_epi8('\\');
+	auto const control = _mm_set1_epi8(0x1F);
+	for (; end - pos >= 16; pos += 16) {
+		auto chars = _mm_loadu_si128(static_cast<__m128i const *>(
+			static_cast<void const *>(pos)
+		));
+		auto special = _mm_or_si128(
+			_mm_or_si128(
+				_mm_cmpeq_epi8(chars, quote),
+				_mm_cmpeq_epi8(chars, backslash)
+			),
+			_mm_cmpeq_epi8(_mm_max_epu8(chars, control), control)
+		);
+		if (auto mask = _mm_movemask_epi8(special); mask != 0) {
+			return pos + __builtin_ctz(static_cast<unsigned>(mask));
+		}
+	}
+#endif
+	while (pos != end and not needsEscape(*pos)) {
+		++pos;
+	}
+	return pos;
+}
+
+void appendEscape(std::string &out, char c)
+{
+	constexpr char kHexDigits[] = "0123456789abcdef";
+	switch (c) {
+	case '"':
+		out.append("\\\"");
+		break;
+	case '\\':
+		out.append("\\\\");
+		break;
+	case '\b':
+		out.append("\\b");
+		break;
+	case '\f':
+		out.append("\\f");
+		break;
+	case '\n':
+		out.append("\\n");
+		break;
+	case '\r':
+		out.append("\\r");
+		break;
+	case '\t':
+		out.append("\\t");
+		break;
+	default: {
+		auto code = static_cast<unsigned char>(c);
+		char escape[] = {'\\', 'u', '0', '0',
+			kHexDigits[code >> 4], kHexDigits[code & 0xF]};
+		out.append(escape, sizeof(escape));
+		break;
+	}
+	}
+}
+
 } // namespace json::anonymous
 
 } // namespace json
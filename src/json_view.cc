@@ -0,0 +1,1007 @@
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <memory>
+#include <span>
+#include <stdexcept>
+#include <system_error>
+#include <utility>
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+#include "json_view.h"
+#include "utils.h"
+
+namespace json {
+
+namespace {
+
+// Bit i of each mask is set if byte i of a 64-byte block is of that class
+struct BlockMasks {
+	std::uint64_t backslash;
+	std::uint64_t quote;
+	std::uint64_t whitespace;
+	std::uint64_t op;
+};
+
+[[maybe_unused]] [[nodiscard]] BlockMasks
+	classifyScalar(char const *block) noexcept
+{
+	BlockMasks masks{};
+	for (unsigned i = 0; i != 64; ++i) {
+		auto bit = std::uint64_t{1} << i;
+		switch (block[i]) {
+		case '\\':
+			masks.backslash |= bit;
+			break;
+		case '"':
+			masks.quote |= bit;
+			break;
+		case ' ':
+		case '\t':
+		case '\n':
+		case '\r':
+			masks.whitespace |= bit;
+			break;
+		case '{':
+		case '}':
+		case '[':
+		case ']':
+		case ':':
+		case ',':
+			masks.op |= bit;
+			break;
+		default:
+			break;
+		}
+	}
+	return masks;
+}
+
+#if defined(__x86_64__)
+
+// '[' and ']' differ from '{' and '}' only in bit 0x20
+[[nodiscard]] BlockMasks classifySse2(char const *block) noexcept
+{
+	BlockMasks masks{};
+	for (unsigned k = 0; k != 4; ++k) {
+		auto v = _mm_loadu_si128(static_cast<__m128i const *>(
+			static_cast<void const *>(block + 16 * k)
+		));
+		auto is = [v](char c) noexcept {
+			return _mm_cmpeq_epi8(v, _mm_set1_epi8(c));
+		};
+		auto folded = _mm_or_si128(v, _mm_set1_epi8(0x20));
+		auto op = _mm_or_si128(
+			_mm_or_si128(
+				_mm_cmpeq_epi8(folded, _mm_set1_epi8('{')),
+				_mm_cmpeq_epi8(folded, _mm_set1_epi8('}'))
+			),
+			_mm_or_si128(is(':'), is(','))
+		);
+		auto whitespace = _mm_or_si128(
+			_mm_or_si128(is(' '), is('\t')),
+			_mm_or_si128(is('\n'), is('\r'))
+		);
+		auto bits = [k](__m128i m) noexcept {
+			return static_cast<std::uint64_t>(
+				static_cast<std::uint16_t>(_mm_movemask_epi8(m))
+			) << (16 * k);
+		};
+		masks.backslash |= bits(is('\\'));
+		masks.quote |= bits(is('"'));
+		masks.whitespace |= bits(whitespace);
+		masks.op |= bits(op);
+	}
+	return masks;
+}
+
+// No lambdas here: they would not inherit the target attribute
+[[gnu::target("avx2")]] [[nodiscard]] BlockMasks
+	classifyAvx2(char const *block) noexcept
+{
+	BlockMasks masks{};
+	for (unsigned k = 0; k != 2; ++k) {
+		auto v = _mm256_loadu_si256(static_cast<__m256i const *>(
+			static_cast<void const *>(block + 32 * k)
+		));
+		auto folded = _mm256_or_si256(v, _mm256_set1_epi8(0x20));
+		auto op = _mm256_or_si256(
+			_mm256_or_si256(
+				_mm256_cmpeq_epi8(folded, _mm256_set1_epi8('{')),
+				_mm256_cmpeq_epi8(folded, _mm256_set1_epi8('}'))
+			),
+			_mm256_or_si256(
+				_mm256_cmpeq_epi8(v, _mm256_set1_epi8(':')),
+				_mm256_cmpeq_epi8(v, _mm256_set1_epi8(','))
+			)
+		);
+		auto whitespace = _mm256_or_si256(
+			_mm256_or_si256(
+				_mm256_cmpeq_epi8(v, _mm256_set1_epi8(' ')),
+				_mm256_cmpeq_epi8(v, _mm256_set1_epi8('\t'))
+			),
+			_mm256_or_si256(
+				_mm256_cmpeq_epi8(v, _mm256_set1_epi8('\n')),
+				_mm256_cmpeq_epi8(v, _mm256_set1_epi8('\r'))
+			)
+		);
+		auto backslash = _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\\'));
+		auto quote = _mm256_cmpeq_epi8(v, _mm256_set1_epi8('"'));
+		auto shift = 32 * k;
+		masks.backslash |= static_cast<std::uint64_t>(
+			static_cast<std::uint32_t>(_mm256_movemask_epi8(backslash))
+		) << shift;
+		masks.quote |= static_cast<std::uint64_t>(
+			static_cast<std::uint32_t>(_mm256_movemask_epi8(quote))
+		) << shift;
+		masks.whitespace |= static_cast<std::uint64_t>(
+			static_cast<std::uint32_t>(_mm256_movemask_epi8(whitespace))
+		) << shift;
+		masks.op |= static_cast<std::uint64_t>(
+			static_cast<std::uint32_t>(_mm256_movemask_epi8(op))
+		) << shift;
+	}
+	return masks;
+}
+
+#endif
+
+using Classifier = BlockMasks (*)(char const *) noexcept;
+
+[[nodiscard]] Classifier selectClassifier() noexcept
+{
+#if defined(__x86_64__)
+	if (__builtin_cpu_supports("avx2")) {
+		return classifyAvx2;
+	}
+	return classifySse2;
+#else
+	return classifyScalar;
+#endif
+}
+
+// Characters preceded by an odd number of backslashes. The carry tells
+// whether the first character of the next block is escaped
+[[nodiscard]] std::uint64_t findEscaped(std::uint64_t backslash,
+	std::uint64_t &carry) noexcept
+{
+	constexpr std::uint64_t kEvenBits = 0x5555'5555'5555'5555;
+	backslash &= ~carry;
+	auto follows_escape = backslash << 1 | carry;
+	auto odd_starts = backslash & ~kEvenBits & ~follows_escape;
+	std::uint64_t even_starts;
+	carry = __builtin_add_overflow(odd_starts, backslash, &even_starts);
+	auto invert_mask = even_starts << 1;
+	return (kEvenBits ^ invert_mask) & follows_escape;
+}
+
+// Bit i is the parity of the bits 0..i
+[[nodiscard]] std::uint64_t prefixXor(std::uint64_t bits) noexcept
+{
+	bits ^= bits << 1;
+	bits ^= bits << 2;
+	bits ^= bits << 4;
+	bits ^= bits << 8;
+	bits ^= bits << 16;
+	bits ^= bits << 32;
+	return bits;
+}
+
+} // namespace json::anonymous
+
+namespace detail {
+
+class Cursor {
+public:
+	Cursor(std::string_view input,
+		std::span<std::uint32_t const> index) noexcept
+		: input_{input}
+		, index_{index}
+	{
+	}
+
+	[[noreturn]] void fail(char const *what) const
+	{
+		throw ParseError{
+			what,
+			next_ != index_.size() ? index_[next_] : input_.size()
+		};
+	}
+
+	[[nodiscard]] char peek() const
+	{
+		if (next_ == index_.size()) {
+			fail("unexpected end of input");
+		}
+		return input_[index_[next_]];
+	}
+
+	[[nodiscard]] bool consume(char c)
+	{
+		if (peek() != c) {
+			return false;
+		}
+		++next_;
+		return true;
+	}
+
+	void expect(char c)
+	{
+		if (not consume(c)) {
+			fail("unexpected character");
+		}
+	}
+
+	// the first character of the last consumed token
+	[[nodiscard]] char previous() const noexcept
+	{
+		return input_[index_[next_ - 1]];
+	}
+
+	// the opening quote must already be consumed,
+	// the closing one is the next structural character
+	[[nodiscard]] view::String readString()
+	{
+		if (peek() != '"') {
+			fail("unterminated string");
+		}
+		auto first = index_[next_ - 1] + std::size_t{1};
+		auto last = index_[next_++];
+		auto raw = input_.substr(first, last - first);
+		return {raw, raw.find('\\') != raw.npos};
+	}
+
+	[[nodiscard]] bool readBoolean()
+	{
+		auto token = readScalar();
+		if (token == "true") {
+			return true;
+		}
+		if (token != "false") {
+			fail("unexpected literal");
+		}
+		return false;
+	}
+
+	template <typename Result>
+	[[nodiscard]] Result readNumber()
+	{
+		auto token = readScalar();
+		auto number = parseNumber(token);
+		if (not number) {
+			failAt(token, "invalid number");
+		}
+		return std::visit([](auto value) noexcept {
+			return Result{value};
+		}, *number);
+	}
+
+	[[nodiscard]] bool atEnd() const noexcept
+	{
+		return next_ == index_.size();
+	}
+
+	[[nodiscard]] std::size_t tell() const noexcept
+	{
+		return next_;
+	}
+
+	void seek(std::size_t next) noexcept
+	{
+		next_ = next;
+	}
+
+	// the text from the next value to the token after it
+	[[nodiscard]] std::string_view skipRaw()
+	{
+		static_cast<void>(peek());
+		auto first = index_[next_];
+		skipElement();
+		std::size_t last = next_ != index_.size() ?
+			index_[next_] :
+			input_.size();
+		return trimEnd(input_.substr(first, last - first));
+	}
+
+	// every string takes two tokens and every other scalar one,
+	// so a value can be skipped by counting brackets
+	void skipElement()
+	{
+		std::size_t depth = 0;
+		do {
+			switch (peek()) {
+			case '{':
+			case '[':
+				++depth;
+				break;
+			case '}':
+			case ']':
+				if (depth == 0) {
+					fail("unexpected character");
+				}
+				--depth;
+				break;
+			case '"':
+				++next_;
+				break;
+			default:
+				break;
+			}
+			++next_;
+		} while (depth != 0);
+	}
+
+private:
+	[[noreturn]] void failAt(std::string_view token, char const *what) const
+	{
+		throw ParseError{
+			what,
+			static_cast<std::size_t>(token.data() - input_.data())
+		};
+	}
+
+	// a scalar runs until whitespace or the next structural character
+	[[nodiscard]] std::string_view readScalar()
+	{
+		if (atEnd()) {
+			fail("unexpected end of input");
+		}
+		auto first = index_[next_++];
+		std::size_t last = next_ != index_.size() ?
+			index_[next_] :
+			input_.size();
+		return trimEnd(input_.substr(first, last - first));
+	}
+
+	[[nodiscard]] static std::string_view trimEnd(std::string_view token)
+		noexcept
+	{
+		while (not token.empty() and (token.back() == ' ' or
+				token.back() == '\n' or token.back() == '\r' or
+				token.back() == '\t')) {
+			token.remove_suffix(1);
+		}
+		return token;
+	}
+
+private:
+	std::string_view input_;
+	std::span<std::uint32_t const> index_;
+	std::size_t next_ = 0;
+};
+
+} // namespace json::detail
+
+namespace {
+
+using detail::Cursor;
+
+// Builds the independent DOM of json.h
+class DocumentBuilder {
+public:
+	using Element = json::Element;
+	using ObjectFrame = Element;
+	using ArrayFrame = Element;
+
+	[[nodiscard]] static Element makeString(view::String str)
+	{
+		return str.isEscaped() ? str.decode() : std::string{str.raw()};
+	}
+
+	[[nodiscard]] static ObjectFrame beginObject()
+	{
+		return Element{std::in_place_type<Object>};
+	}
+
+	static void addMember(ObjectFrame &frame, view::String key, Element &&value)
+	{
+		frame.asObject().emplace(
+			key.isEscaped() ? key.decode() : std::string{key.raw()},
+			std::move(value)
+		);
+	}
+
+	[[nodiscard]] static Element endObject(ObjectFrame &frame) noexcept
+	{
+		return std::move(frame);
+	}
+
+	[[nodiscard]] static ArrayFrame beginArray()
+	{
+		return Element{std::in_place_type<Array>};
+	}
+
+	static void addElement(ArrayFrame &frame, Element &&value)
+	{
+		frame.asArray().push_back(std::move(value));
+	}
+
+	[[nodiscard]] static Element endArray(ArrayFrame &frame) noexcept
+	{
+		return std::move(frame);
+	}
+};
+
+// Builds the DOM of views into the input. Members and elements of
+// unfinished containers are collected on stacks shared by all levels,
+// and moved to the arena in one piece when a container is finished
+class ViewBuilder {
+public:
+	using Element = view::Element;
+	using ObjectFrame = std::size_t;
+	using ArrayFrame = std::size_t;
+
+	explicit ViewBuilder(std::pmr::memory_resource *arena) noexcept
+		: arena_{arena}
+	{
+	}
+
+	[[nodiscard]] static Element makeString(view::String str) noexcept
+	{
+		return str;
+	}
+
+	[[nodiscard]] ObjectFrame beginObject() const noexcept
+	{
+		return members_.size();
+	}
+
+	void addMember(ObjectFrame, view::String key, Element &&value)
+	{
+		members_.emplace_back(
+			key.isEscaped() ? copy(key.decode()) : key.raw(),
+			value
+		);
+	}
+
+	[[nodiscard]] Element endObject(ObjectFrame frame)
+	{
+		auto size = view::sortMembers(
+			members_.data() + frame,
+			members_.size() - frame
+		);
+		auto *members = allocate<view::Object::Member>(size);
+		std::uninitialized_copy_n(members_.data() + frame, size, members);
+		members_.resize(frame);
+		return view::Object{members, size};
+	}
+
+	[[nodiscard]] ArrayFrame beginArray() const noexcept
+	{
+		return elements_.size();
+	}
+
+	void addElement(ArrayFrame, Element &&value)
+	{
+		elements_.push_back(value);
+	}
+
+	[[nodiscard]] Element endArray(ArrayFrame frame)
+	{
+		auto first = elements_.begin() + static_cast<std::ptrdiff_t>(frame);
+		auto size = static_cast<std::size_t>(elements_.end() - first);
+		auto *elements = allocate<Element>(size);
+		std::uninitialized_copy(first, elements_.end(), elements);
+		elements_.resize(frame);
+		return view::Array{elements, size};
+	}
+
+private:
+	template <typename T>
+	[[nodiscard]] T *allocate(std::size_t size)
+	{
+		return static_cast<T *>(
+			arena_->allocate(size * sizeof(T), alignof(T))
+		);
+	}
+
+	[[nodiscard]] std::string_view copy(std::string const &str)
+	{
+		auto *data = allocate<char>(str.size());
+		str.copy(data, str.size());
+		return {data, str.size()};
+	}
+
+private:
+	std::pmr::memory_resource *arena_;
+	std::vector<view::Object::Member> members_;
+	std::vector<Element> elements_;
+};
+
+template <typename Builder>
+[[nodiscard]] typename Builder::Element readValue(Cursor &, Builder &);
+
+template <typename Builder>
+[[nodiscard]] typename Builder::Element
+	readObject(Cursor &cursor, Builder &builder)
+{
+	auto frame = builder.beginObject();
+	if (not cursor.consume('}')) {
+		do {
+			cursor.expect('"');
+			auto key = cursor.readString();
+			cursor.expect(':');
+			builder.addMember(frame, key, readValue(cursor, builder));
+		} while (cursor.consume(','));
+		cursor.expect('}');
+	}
+	return builder.endObject(frame);
+}
+
+template <typename Builder>
+[[nodiscard]] typename Builder::Element
+	readArray(Cursor &cursor, Builder &builder)
+{
+	auto frame = builder.beginArray();
+	if (not cursor.consume(']')) {
+		do {
+			builder.addElement(frame, readValue(cursor, builder));
+		} while (cursor.consume(','));
+		cursor.expect(']');
+	}
+	return builder.endArray(frame);
+}
+
+template <typename Builder>
+typename Builder::Element readValue(Cursor &cursor, Builder &builder)
+{
+	using Element = typename Builder::Element;
+	switch (cursor.peek()) {
+	case '{':
+		cursor.expect('{');
+		return readObject(cursor, builder);
+	case '[':
+		cursor.expect('[');
+		return readArray(cursor, builder);
+	case '"':
+		cursor.expect('"');
+		return Builder::makeString(cursor.readString());
+	case 't':
+	case 'f':
+		return Element{cursor.readBoolean()};
+	default:
+		return cursor.readNumber<Element>();
+	}
+}
+
+void finishRoot(Cursor const &cursor)
+{
+	if (not cursor.atEnd()) {
+		cursor.fail("trailing characters");
+	}
+}
+
+template <typename Builder>
+[[nodiscard]] typename Builder::Element
+	readRoot(std::string_view input, Builder &builder)
+{
+	auto index = indexStructure(input);
+	Cursor cursor{input, index};
+	auto element = readValue(cursor, builder);
+	finishRoot(cursor);
+	return element;
+}
+
+void appendUtf8(std::string &str, std::uint32_t code)
+{
+	if (code < 0x80) {
+		str.push_back(static_cast<char>(code));
+	} else if (code < 0x800) {
+		str.push_back(static_cast<char>(0xC0 | (code >> 6)));
+		str.push_back(static_cast<char>(0x80 | (code & 0x3F)));
+	} else if (code < 0x10000) {
+		str.push_back(static_cast<char>(0xE0 | (code >> 12)));
+		str.push_back(static_cast<char>(0x80 | ((code >> 6) & 0x3F)));
+		str.push_back(static_cast<char>(0x80 | (code & 0x3F)));
+	} else {
+		str.push_back(static_cast<char>(0xF0 | (code >> 18)));
+		str.push_back(static_cast<char>(0x80 | ((code >> 12) & 0x3F)));
+		str.push_back(static_cast<char>(0x80 | ((code >> 6) & 0x3F)));
+		str.push_back(static_cast<char>(0x80 | (code & 0x3F)));
+	}
+}
+
+[[nodiscard]] std::uint32_t readHex4(std::string_view raw, std::size_t pos)
+{
+	if (raw.size() - pos < 4) {
+		throw ParseError{"truncated \\u escape", pos};
+	}
+	std::uint32_t code{};
+	for (auto c : raw.substr(pos, 4)) {
+		code <<= 4;
+		if (c >= '0' and c <= '9') {
+			code |= static_cast<std::uint32_t>(c - '0');
+		} else if (c >= 'a' and c <= 'f') {
+			code |= static_cast<std::uint32_t>(c - 'a' + 10);
+		} else if (c >= 'A' and c <= 'F') {
+			code |= static_cast<std::uint32_t>(c - 'A' + 10);
+		} else {
+			throw ParseError{"invalid \\u escape", pos};
+		}
+	}
+	return code;
+}
+
+} // namespace json::anonymous
+
+Buffer Buffer::map(std::string const &path)
+{
+	Buffer buffer;
+	buffer.file_ = utils::MappedFile{path};
+	return buffer;
+}
+
+Buffer Buffer::read(int fd)
+{
+	Buffer buffer;
+	struct stat st{};
+	if (::fstat(fd, &st) == 0 and S_ISREG(st.st_mode) and st.st_size != 0 and
+			::lseek(fd, 0, SEEK_CUR) == 0) {
+		buffer.file_ = utils::MappedFile{fd};
+		return buffer;
+	}
+	constexpr std::size_t kChunkSize = 1 << 16;
+	auto &data = buffer.data_;
+	for (;;) {
+		auto size = data.size();
+		data.resize(size + kChunkSize);
+		auto n = ::read(fd, data.data() + size, kChunkSize);
+		if (n < 0 and errno == EINTR) {
+			data.resize(size);
+			continue;
+		}
+		if (n < 0) {
+			throw std::system_error{errno, std::generic_category(), "read"};
+		}
+		data.resize(size + static_cast<std::size_t>(n));
+		if (n == 0) {
+			return buffer;
+		}
+	}
+}
+
+// Stage one of reading: every 64-byte block is classified with SIMD,
+// then strings are masked out with bit arithmetic, and the positions
+// of structural characters, quotes and the first characters of
+// scalars are extracted from the remaining bits
+std::vector<std::uint32_t> indexStructure(std::string_view input)
+{
+	std::vector<std::uint32_t> index;
+	indexStructure(input, index);
+	return index;
+}
+
+void indexStructure(std::string_view input, std::vector<std::uint32_t> &index)
+{
+	if (input.size() > std::numeric_limits<std::uint32_t>::max()) {
+		throw ParseError{"input is too large", 0};
+	}
+	static Classifier const classify = selectClassifier();
+
+	index.clear();
+	std::size_t count = 0;
+	std::uint64_t escaped_carry = 0;
+	std::uint64_t in_string_carry = 0;
+	std::uint64_t scalar_carry = 0;
+	for (std::size_t offset = 0; offset < input.size(); offset += 64) {
+		char tail[64];
+		auto const *block = input.data() + offset;
+		if (input.size() - offset < 64) {
+			std::memset(tail, ' ', sizeof(tail));
+			std::memcpy(tail, block, input.size() - offset);
+			block = tail;
+		}
+		auto masks = classify(block);
+
+		auto escaped = findEscaped(masks.backslash, escaped_carry);
+		auto quote = masks.quote & ~escaped;
+		auto in_string = prefixXor(quote) ^ in_string_carry;
+		in_string_carry = static_cast<std::uint64_t>(
+			static_cast<std::int64_t>(in_string) >> 63
+		);
+		auto scalar = ~(masks.op | masks.whitespace | quote | in_string);
+		auto scalar_start = scalar & ~(scalar << 1 | scalar_carry);
+		scalar_carry = scalar >> 63;
+		auto structural = (masks.op & ~in_string) | quote | scalar_start;
+
+		// writing past the count is cheaper than branching on each bit
+		index.resize(count + 64);
+		for (; structural != 0; structural &= structural - 1) {
+			index[count++] = static_cast<std::uint32_t>(
+				offset + static_cast<unsigned>(__builtin_ctzll(structural))
+			);
+		}
+	}
+	if (in_string_carry != 0) {
+		throw ParseError{"unterminated string", input.size()};
+	}
+	index.resize(count);
+}
+
+Document readDocument(std::string_view input)
+{
+	DocumentBuilder builder;
+	return Document{readRoot(input, builder)};
+}
+
+namespace view {
+
+std::string String::decode() const
+{
+	if (not is_escaped_) {
+		return std::string{raw_};
+	}
+	std::string str;
+	str.reserve(raw_.size());
+	for (std::size_t i = 0; i != raw_.size(); ++i) {
+		if (raw_[i] != '\\') {
+			str.push_back(raw_[i]);
+			continue;
+		}
+		if (++i == raw_.size()) {
+			throw ParseError{"truncated escape", i};
+		}
+		switch (raw_[i]) {
+		case '"':
+		case '\\':
+		case '/':
+			str.push_back(raw_[i]);
+			break;
+		case 'b':
+			str.push_back('\b');
+			break;
+		case 'f':
+			str.push_back('\f');
+			break;
+		case 'n':
+			str.push_back('\n');
+			break;
+		case 'r':
+			str.push_back('\r');
+			break;
+		case 't':
+			str.push_back('\t');
+			break;
+		case 'u': {
+			auto start = i - 1;
+			auto code = readHex4(raw_, i + 1);
+			i += 4;
+			if (code >= 0xD800 and code < 0xDC00 and
+					raw_.substr(i + 1).starts_with("\\u")) {
+				auto low = readHex4(raw_, i + 3);
+				if (low >= 0xDC00 and low < 0xE000) {
+					code = 0x10000 + ((code - 0xD800) << 10) + (low - 0xDC00);
+					i += 6;
+				}
+			}
+			if (code >= 0xD800 and code < 0xE000) {
+				throw ParseError{"lone surrogate in \\u escape", start};
+			}
+			appendUtf8(str, code);
+			break;
+		}
+		default:
+			throw ParseError{"invalid escape", i - 1};
+		}
+	}
+	return str;
+}
+
+Element const &Object::at(std::string_view key) const
+{
+	if (auto const *element = find(key)) {
+		return *element;
+	}
+	throw std::out_of_range{"json: no key " + std::string{key}};
+}
+
+Element const *Object::find(std::string_view key) const noexcept
+{
+	constexpr std::size_t kLinearSearchSize = 8;
+	Member const *it;
+	if (size_ <= kLinearSearchSize) {
+		it = std::find_if(begin(), end(), [key](auto const &member) noexcept {
+			return member.first == key;
+		});
+	} else {
+		it = std::lower_bound(begin(), end(), key,
+			[](auto const &member, std::string_view k) noexcept {
+				return member.first < k;
+			});
+	}
+	return it != end() and it->first == key ? &it->second : nullptr;
+}
+
+std::size_t sortMembers(Object::Member *members, std::size_t size)
+{
+	std::stable_sort(members, members + size,
+		[](auto const &lhs, auto const &rhs) noexcept {
+			return lhs.first < rhs.first;
+		});
+	auto *last = std::unique(members, members + size,
+		[](auto const &lhs, auto const &rhs) noexcept {
+			return lhs.first == rhs.first;
+		});
+	return static_cast<std::size_t>(last - members);
+}
+
+Document::Document()
+	: arena_{std::make_unique<Arena>()}
+{
+}
+
+Document readDocument(std::string_view input)
+{
+	Document document;
+	ViewBuilder builder{&document.arena_->resource};
+	document.root_ = readRoot(input, builder);
+	return document;
+}
+
+json::Element toElement(Element const &element)
+{
+	return std::visit(utils::overloaded{
+		[](Object const &object) {
+			json::Element copy{std::in_place_type<json::Object>};
+			for (auto const &[key, value] : object) {
+				copy.asObject().emplace(key, toElement(value));
+			}
+			return copy;
+		},
+		[](Array const &array) {
+			json::Element copy{std::in_place_type<json::Array>};
+			copy.asArray().reserve(array.size());
+			for (auto const &value : array) {
+				copy.asArray().push_back(toElement(value));
+			}
+			return copy;
+		},
+		[](String const &str) {
+			return json::Element{str.decode()};
+		},
+		[](auto value) noexcept {
+			return json::Element{value};
+		},
+	}, element.getBase());
+}
+
+} // namespace json::view
+
+Reader::Reader(std::string_view input)
+	: index_{indexStructure(input)}
+	, cursor_{std::make_unique<Cursor>(input, index_)}
+{
+}
+
+Reader::Reader(std::string_view input, std::vector<std::uint32_t> &&index)
+	: index_{std::move(index)}
+{
+	indexStructure(input, index_);
+	cursor_ = std::make_unique<Cursor>(input, index_);
+}
+
+Reader::Reader(std::unique_ptr<Cursor> cursor) noexcept
+	: cursor_{std::move(cursor)}
+{
+}
+
+Reader::Reader(Reader &&) noexcept = default;
+
+Reader::~Reader() = default;
+
+void Reader::enterObject()
+{
+	cursor_->expect('{');
+}
+
+bool Reader::nextMember(view::String &key)
+{
+	if (cursor_->consume('}')) {
+		return false;
+	}
+	if (cursor_->previous() != '{') {
+		cursor_->expect(',');
+	}
+	cursor_->expect('"');
+	key = cursor_->readString();
+	cursor_->expect(':');
+	return true;
+}
+
+void Reader::enterArray()
+{
+	cursor_->expect('[');
+}
+
+bool Reader::nextElement()
+{
+	if (cursor_->consume(']')) {
+		return false;
+	}
+	if (cursor_->previous() != '[') {
+		cursor_->expect(',');
+	}
+	return true;
+}
+
+view::String Reader::readString()
+{
+	cursor_->expect('"');
+	return cursor_->readString();
+}
+
+Int Reader::readInteger()
+{
+	auto number = cursor_->readNumber<view::Element>();
+	if (not std::holds_alternative<Int>(number.getBase())) {
+		cursor_->fail("expected an integer");
+	}
+	return number.asInteger();
+}
+
+double Reader::readDouble()
+{
+	return cursor_->readNumber<view::Element>().asDouble();
+}
+
+bool Reader::readBoolean()
+{
+	return cursor_->readBoolean();
+}
+
+view::Document Reader::readDocument()
+{
+	return view::Document::build([this](std::pmr::memory_resource &arena) {
+		ViewBuilder builder{&arena};
+		return readValue(*cursor_, builder);
+	});
+}
+
+Element Reader::readElement()
+{
+	DocumentBuilder builder;
+	return readValue(*cursor_, builder);
+}
+
+void Reader::skip()
+{
+	cursor_->skipElement();
+}
+
+std::string_view Reader::readRaw()
+{
+	return cursor_->skipRaw();
+}
+
+void Reader::finish() const
+{
+	finishRoot(*cursor_);
+}
+
+Reader::Position Reader::tell() const noexcept
+{
+	return cursor_->tell();
+}
+
+Reader Reader::fork(Position position) const
+{
+	auto cursor = std::make_unique<Cursor>(*cursor_);
+	cursor->seek(position);
+	return Reader{std::move(cursor)};
+}
+
+std::vector<std::uint32_t> Reader::releaseIndex() && noexcept
+{
+	cursor_.reset();
+	return std::move(index_);
+}
+
+} // namespace json
@@ -0,0 +1,227 @@
+#include <charconv>
+#include <iterator>
+#include <system_error>
+
+#include "json_writer.h"
+#include "utils.h"
+#include "utils_io.h"
+
+namespace json {
+
+Writer::Writer(int fd, Doubles doubles)
+	: fd_{fd}
+	, doubles_{doubles}
+{
+	if (fd_ >= 0) {
+		buffer_.reserve(2 * kFlushSize);
+	}
+}
+
+Writer::Writer(Fork, Doubles doubles) noexcept
+	: fd_{-1}
+	, doubles_{doubles}
+{
+}
+
+Writer::~Writer()
+{
+	try {
+		flush();
+	} catch (std::system_error const &) {
+	}
+}
+
+void Writer::beginObject(std::size_t)
+{
+	separate();
+	buffer_.push_back('{');
+	needs_comma_ = false;
+}
+
+void Writer::endObject()
+{
+	buffer_.push_back('}');
+	finishValue();
+}
+
+void Writer::beginArray(std::size_t)
+{
+	separate();
+	buffer_.push_back('[');
+	needs_comma_ = false;
+}
+
+void Writer::endArray()
+{
+	buffer_.push_back(']');
+	finishValue();
+}
+
+void Writer::writeKey(std::string_view key)
+{
+	writeString(key);
+	buffer_.append(": ");
+	needs_comma_ = false;
+}
+
+void Writer::writeString(std::string_view str)
+{
+	separate();
+	appendQuoted(buffer_, str);
+	finishValue();
+}
+
+void Writer::writeInteger(Int number)
+{
+	separate();
+	char chars[24];
+	auto [end, error] = std::to_chars(std::begin(chars), std::end(chars),
+		number);
+	buffer_.append(chars, end);
+	finishValue();
+}
+
+// The compatible format is the one of printf("%.6g"),
+// which std::ostream uses by default
+void Writer::writeDouble(double number)
+{
+	constexpr int kCompatiblePrecision = 6;
+	separate();
+	char chars[32];
+	auto [end, error] = doubles_ == Doubles::kShortest ?
+		std::to_chars(std::begin(chars), std::end(chars), number) :
+		std::to_chars(std::begin(chars), std::end(chars), number,
+			std::chars_format::general, kCompatiblePrecision);
+	buffer_.append(chars, end);
+	finishValue();
+}
+
+void Writer::writeBoolean(bool boolean)
+{
+	separate();
+	buffer_.append(boolean ? "true" : "false");
+	finishValue();
+}
+
+void Writer::writeElement(Element const &element)
+{
+	std::visit(utils::overloaded{
+		[this](Object const &object) {
+			beginObject(object.size());
+			for (auto const &[key, value] : object) {
+				writeKey(key);
+				writeElement(value);
+			}
+			endObject();
+		},
+		[this](Array const &array) {
+			beginArray(array.size());
+			for (auto const &value : array) {
+				writeElement(value);
+			}
+			endArray();
+		},
+		[this](std::string const &str) {
+			writeString(str);
+		},
+		[this](Int number) {
+			writeInteger(number);
+		},
+		[this](double number) {
+			writeDouble(number);
+		},
+		[this](bool boolean) {
+			writeBoolean(boolean);
+		},
+	}, element.getBase());
+}
+
+void Writer::writeElement(view::Element const &element)
+{
+	std::visit(utils::overloaded{
+		[this](view::Object const &object) {
+			beginObject(object.size());
+			for (auto const &[key, value] : object) {
+				writeKey(key);
+				writeElement(value);
+			}
+			endObject();
+		},
+		[this](view::Array const &array) {
+			beginArray(array.size());
+			for (auto const &value : array) {
+				writeElement(value);
+			}
+			endArray();
+		},
+		[this](view::String const &str) {
+			if (str.isEscaped()) {
+				writeString(str.decode());
+			} else {
+				writeString(str.raw());
+			}
+		},
+		[this](Int number) {
+			writeInteger(number);
+		},
+		[this](double number) {
+			writeDouble(number);
+		},
+		[this](bool boolean) {
+			writeBoolean(boolean);
+		},
+	}, element.getBase());
+}
+
+void Writer::endLine()
+{
+	buffer_.push_back('\n');
+	needs_comma_ = false;
+}
+
+// The buffer is dropped even if writing fails
+void Writer::flush()
+{
+	if (fd_ < 0) {
+		return;
+	}
+	try {
+		utils::writeAll(fd_, buffer_);
+	} catch (...) {
+		buffer_.clear();
+		throw;
+	}
+	buffer_.clear();
+}
+
+Writer Writer::fork() const
+{
+	return Writer{Fork{}, doubles_};
+}
+
+void Writer::join(Writer const &fork)
+{
+	if (fork.buffer_.empty()) {
+		return;
+	}
+	separate();
+	buffer_.append(fork.buffer_);
+	finishValue();
+}
+
+void Writer::separate()
+{
+	if (needs_comma_) {
+		buffer_.append(", ");
+	}
+}
+
+void Writer::finishValue()
+{
+	needs_comma_ = true;
+	if (buffer_.size() >= kFlushSize and fd_ >= 0) {
+		flush();
+	}
+}
+
+} // namespace json
@@ -1,28 +1,409 @@
+#include <exception>
+#include <filesystem>
+#include <functional>
+#include <future>
 #include <iostream>
+#include <memory>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <utility>
+#include <vector>
 
+#include <unistd.h>
+
+#include "batch.h"
 #include "description.h"
 #include "json.h"
+#include "json_view.h"
+#include "json_writer.h"
+#include "msgpack.h"
+#include "options.h"
 #include "request.h"
+#include "server.h"
+#include "server_network.h"
+#include "server_socket.h"
 #include "transport_directory.h"
+#include "utils_io.h"
+#include "utils_memory.h"
+
+namespace {
 
-int main()
+// Without a config the directory is loaded from the snapshot
+std::optional<transport::TransportDirectory> build(
+	options::Options const &options,
+	std::optional<transport::config::Config> config)
 {
-	std::ios_base::sync_with_stdio(false);
-	std::cin.tie(nullptr);
+	try {
+		if (not config) {
+			return transport::TransportDirectory::loadSnapshot(
+				options.load_snapshot
+			);
+		}
+		transport::TransportDirectory built{std::move(*config)};
+		if (not options.save_snapshot.empty()) {
+			built.saveSnapshot(options.save_snapshot);
+		}
+		return built;
+	} catch (std::runtime_error const &e) {
+		std::cerr << e.what() << '\n';
+		return std::nullopt;
+	}
+}
 
-	auto const document = json::readDocument(std::cin);
-	auto const &config = document.getRoot().asObject();
+[[nodiscard]] json::Writer::Doubles getDoubles(options::Options const &options)
+{
+	return options.shortest_doubles ?
+		json::Writer::Doubles::kShortest :
+		json::Writer::Doubles::kCompatible;
+}
 
-	transport::TransportDirectory directory{
-		description::parseConfig(config)
-	};
+[[nodiscard]] std::size_t getWorkersCount(options::Options const &options)
+{
+	return options.workers_count != 0 ?
+		options.workers_count :
+		std::thread::hardware_concurrency();
+}
+
+// Adds what is reported in every mode and writes the report to stderr.
+// The directory is left out if there is none
+template <typename Writer>
+void writeMemoryReport(json::Object report,
+	transport::TransportDirectory const *directory,
+	request::RouteCache<Writer> const &route_cache)
+{
+	if (directory) {
+		report.emplace("directory", request::describeMemoryUsage(
+			directory->getMemoryUsage()
+		));
+	}
+	report.emplace("route_cache", request::describeCacheStats(
+		route_cache.getStats()
+	));
+	json::writeValue(report, std::cerr);
+	std::cerr << '\n';
+}
 
-	auto response = request::processAll(
-		config.at("stat_requests").asArray(),
-		directory
+template <typename Reader, typename Writer>
+int run(options::Options const &options, Reader &reader, Writer &writer)
+{
+	json::Object peak_rss;
+
+	// The directory is built while the requests are still being read,
+	// and with a snapshot the config of the input is not read at all
+	std::future<std::optional<transport::TransportDirectory>> building;
+	std::function<void(transport::config::Config &&)> on_config;
+	if (not options.load_snapshot.empty()) {
+		building = std::async(std::launch::async, build, std::cref(options),
+			std::nullopt);
+	} else {
+		on_config = [&](transport::config::Config &&config) {
+			building = std::async(std::launch::async, build,
+				std::cref(options), std::move(config));
+		};
+	}
+	request::Requests requests;
+	description::readInput(
+		reader,
+		on_config,
+		[&](Reader &input) {
+			requests = request::readRequests(input);
+		}
 	);
+	peak_rss.emplace("parse", static_cast<json::Int>(utils::getPeakRss()));
+
+	auto directory = building.get();
+	if (not directory) {
+		return 1;
+	}
+	peak_rss.emplace("build", static_cast<json::Int>(utils::getPeakRss()));
+
+	request::RouteCache<Writer> route_cache{options.route_cache_size};
+	request::processAll(requests, *directory, writer, &route_cache);
+	writer.flush();
+	peak_rss.emplace("process", static_cast<json::Int>(utils::getPeakRss()));
 
-	json::writeValue(response, std::cout);
+	if (options.memory_report) {
+		writeMemoryReport({
+			{"peak_rss", std::move(peak_rss)},
+			{"requests", static_cast<json::Int>(
+				request::computeMemoryUsage(requests)
+			)},
+			{"response", static_cast<json::Int>(writer.getMemoryUsage())},
+		}, &*directory, route_cache);
+	}
 
 	return 0;
 }
+
+int serve(options::Options const &options)
+{
+	utils::LineReader lines{STDIN_FILENO};
+	std::optional<transport::config::Config> config;
+	if (options.load_snapshot.empty()) {
+		auto base = lines.next();
+		if (not base) {
+			std::cerr << "no base document\n";
+			return 1;
+		}
+		try {
+			json::Reader reader{*base};
+			config = description::readConfig(reader);
+		} catch (std::exception const &e) {
+			std::cerr << e.what() << '\n';
+			return 1;
+		}
+	}
+	auto directory = build(options, std::move(config));
+	if (not directory) {
+		return 1;
+	}
+
+	server::RouteCache route_cache{options.route_cache_size};
+	if (options.pipeline) {
+		auto stats = server::servePipelined(lines, STDOUT_FILENO, *directory,
+			&route_cache, {
+				.workers_count = getWorkersCount(options),
+				.doubles = getDoubles(options),
+			});
+		if (options.memory_report) {
+			writeMemoryReport({
+				{"pipeline", server::describePipelineStats(stats)},
+			}, &*directory, route_cache);
+		}
+		return 0;
+	}
+
+	json::Writer writer{STDOUT_FILENO, getDoubles(options)};
+	server::serveLines(lines, *directory, writer, &route_cache);
+
+	if (options.memory_report) {
+		writeMemoryReport({
+			{"response", static_cast<json::Int>(writer.getMemoryUsage())},
+		}, &*directory, route_cache);
+	}
+
+	return 0;
+}
+
+// throws std::system_error or std::runtime_error on failure
+[[nodiscard]] transport::TransportDirectory readBase(std::string const &path)
+{
+	auto const buffer = json::Buffer::map(path);
+	json::Reader reader{buffer.view()};
+	return transport::TransportDirectory{description::readConfig(reader)};
+}
+
+// A network hosted by name is a base document if its file ends
+// in .json, and a snapshot if it ends in .snapshot
+[[nodiscard]] transport::TransportDirectory loadNetwork(
+	std::string const &path)
+{
+	if (path.ends_with(".json")) {
+		return readBase(path);
+	}
+	return transport::TransportDirectory::loadSnapshot(path);
+}
+
+// Builds the network again from the files it was built from, throws
+// std::runtime_error on failure. Nothing if it was read from the input
+[[nodiscard]] std::function<transport::TransportDirectory()> getReload(
+	options::Options const &options)
+{
+	if (not options.load_snapshot.empty()) {
+		return [&options] {
+			return transport::TransportDirectory::loadSnapshot(
+				options.load_snapshot
+			);
+		};
+	}
+	if (not options.base.empty()) {
+		return [&options] {
+			return readBase(options.base);
+		};
+	}
+	return {};
+}
+
+// Adds the networks of the files in the directory, named by the files
+// without their extension. Throws std::filesystem::filesystem_error
+void addNetworks(std::string const &path, server::NetworkRegistry &networks)
+{
+	for (auto const &file : std::filesystem::directory_iterator{path}) {
+		auto extension = file.path().extension();
+		if (file.is_regular_file() and
+				(extension == ".json" or extension == ".snapshot")) {
+			networks.add(file.path().stem().string(), file.path().string());
+		}
+	}
+}
+
+// The server signals are blocked before the thread pool is started
+// by building the directory. With networks hosted by name, the default
+// network is only built if its file is given
+int listen(options::Options const &options)
+{
+	server::blockServerSignals();
+	server::RouteCache route_cache{options.route_cache_size};
+	server::NetworkRegistry networks{
+		route_cache, options.network_memory, loadNetwork
+	};
+	if (not options.networks.empty()) {
+		try {
+			addNetworks(options.networks, networks);
+		} catch (std::filesystem::filesystem_error const &e) {
+			std::cerr << e.what() << '\n';
+			return 1;
+		}
+	}
+
+	if (options.networks.empty() or not options.base.empty() or
+			not options.load_snapshot.empty()) {
+		std::optional<transport::config::Config> config;
+		if (options.load_snapshot.empty()) {
+			try {
+				auto const buffer = options.base.empty() ?
+					json::Buffer::read(0) :
+					json::Buffer::map(options.base);
+				json::Reader reader{buffer.view()};
+				config = description::readConfig(reader);
+			} catch (std::exception const &e) {
+				std::cerr << e.what() << '\n';
+				return 1;
+			}
+		}
+		auto directory = build(options, std::move(config));
+		if (not directory) {
+			return 1;
+		}
+		networks.setDefault(std::move(*directory));
+	}
+
+	server::SchedulerStats stats;
+	try {
+		stats = server::listen({
+			.address = options.listen,
+			.workers_count = getWorkersCount(options),
+			.doubles = getDoubles(options),
+			.reload = getReload(options),
+		}, networks);
+	} catch (std::system_error const &e) {
+		std::cerr << e.what() << '\n';
+		return 1;
+	}
+
+	if (options.memory_report) {
+		json::Object report{
+			{"networks", server::describeRegistryStats(networks.getStats())},
+			{"scheduler", server::describeSchedulerStats(stats)},
+		};
+		std::shared_ptr<server::Network const> network;
+		if (auto *slot = networks.getDefault()) {
+			network = slot->get();
+			report.emplace("network",
+				server::describeNetworkStats(slot->getStats()));
+		}
+		writeMemoryReport(std::move(report),
+			network ? &network->directory : nullptr, route_cache);
+	}
+
+	return 0;
+}
+
+int connect(options::Options const &options)
+{
+	try {
+		server::connect(options.connect, STDIN_FILENO, STDOUT_FILENO);
+	} catch (std::system_error const &e) {
+		std::cerr << e.what() << '\n';
+		return 1;
+	}
+	return 0;
+}
+
+// Fails if any of the inputs does
+int runBatch(options::Options const &options)
+{
+	std::vector<std::string> inputs;
+	try {
+		inputs = batch::listInputs(options.batch);
+	} catch (std::system_error const &e) {
+		std::cerr << e.what() << '\n';
+		return 1;
+	}
+
+	auto stats = batch::processFiles(inputs, {
+		.is_msgpack = options.format == options::Format::kMessagePack,
+		.doubles = getDoubles(options),
+		.route_cache_size = options.route_cache_size,
+		.memory_budget = options.network_memory,
+	});
+
+	if (options.memory_report) {
+		json::Object report{
+			{"batch", batch::describeStats(stats)},
+			{"peak_rss", static_cast<json::Int>(utils::getPeakRss())},
+			{"route_cache", request::describeCacheStats(stats.route_cache)},
+		};
+		json::writeValue(report, std::cerr);
+		std::cerr << '\n';
+	}
+
+	return stats.failures_count == 0 ? 0 : 1;
+}
+
+int runMode(options::Options const &options)
+{
+	if (options.serve) {
+		return serve(options);
+	}
+	if (not options.listen.empty()) {
+		return listen(options);
+	}
+	if (not options.connect.empty()) {
+		return connect(options);
+	}
+	if (not options.batch.empty()) {
+		return runBatch(options);
+	}
+	try {
+		auto const buffer = json::Buffer::read(0);
+		if (options.format == options::Format::kMessagePack) {
+			msgpack::Reader reader{buffer.view()};
+			msgpack::Writer writer{STDOUT_FILENO};
+			return run(options, reader, writer);
+		}
+		json::Reader reader{buffer.view()};
+		json::Writer writer{STDOUT_FILENO, getDoubles(options)};
+		return run(options, reader, writer);
+	} catch (std::exception const &e) {
+		std::cerr << e.what() << '\n';
+		return 1;
+	}
+}
+
+} // namespace anonymous
+
+int main(int argc, char const *argv[])
+{
+	std::ios_base::sync_with_stdio(false);
+	std::cin.tie(nullptr);
+
+	options::Options options;
+	try {
+		options = options::parseOptions(argc, argv);
+	} catch (std::exception const &e) {
+		std::cerr << e.what() << '\n' << options::kUsage << '\n';
+		return 1;
+	}
+
+	auto status = runMode(options);
+	if (options.request_stats) {
+		json::writeValue(request::describeMetrics(request::getMetrics()),
+			std::cerr);
+		std::cerr << '\n';
+	}
+	return status;
+}
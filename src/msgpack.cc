@@ -0,0 +1,589 @@
+#include <algorithm>
+#include <bit>
+#include <limits>
+#include <memory>
+#include <system_error>
+#include <utility>
+
+#include "msgpack.h"
+#include "utils.h"
+#include "utils_io.h"
+
+namespace msgpack {
+
+Reader::Reader(std::string_view input) noexcept
+	: input_{input}
+{
+}
+
+void Reader::enterObject()
+{
+	remaining_.push_back(readToken(Kind::kMap).value);
+}
+
+bool Reader::nextMember(json::view::String &key)
+{
+	if (not nextItem()) {
+		return false;
+	}
+	key = readString();
+	return true;
+}
+
+void Reader::enterArray()
+{
+	remaining_.push_back(readToken(Kind::kArray).value);
+}
+
+bool Reader::nextElement()
+{
+	return nextItem();
+}
+
+json::view::String Reader::readString()
+{
+	return {readBytes(readToken(Kind::kString).value), false};
+}
+
+json::Int Reader::readInteger()
+{
+	return toInteger(readToken());
+}
+
+double Reader::readDouble()
+{
+	auto token = readToken();
+	if (token.kind == Kind::kFloat) {
+		return std::bit_cast<double>(token.value);
+	}
+	return static_cast<double>(toInteger(token));
+}
+
+bool Reader::readBoolean()
+{
+	return readToken(Kind::kBoolean).value != 0;
+}
+
+json::view::Document Reader::readDocument()
+{
+	return json::view::Document::build(
+		[this](std::pmr::memory_resource &arena) {
+			return readView(arena);
+		}
+	);
+}
+
+json::Element Reader::readElement()
+{
+	auto token = readToken();
+	if (token.kind == Kind::kMap) {
+		json::Element element{std::in_place_type<json::Object>};
+		for (auto i = token.value; i != 0; --i) {
+			auto key = readString();
+			element.asObject().emplace(key.raw(), readElement());
+		}
+		return element;
+	}
+	if (token.kind == Kind::kArray) {
+		json::Element element{std::in_place_type<json::Array>};
+		for (auto i = token.value; i != 0; --i) {
+			element.asArray().push_back(readElement());
+		}
+		return element;
+	}
+	if (token.kind == Kind::kString) {
+		return std::string{readBytes(token.value)};
+	}
+	if (token.kind == Kind::kFloat) {
+		return std::bit_cast<double>(token.value);
+	}
+	if (token.kind == Kind::kBoolean) {
+		return token.value != 0;
+	}
+	return toInteger(token);
+}
+
+void Reader::skip()
+{
+	auto token = readToken();
+	if (token.kind == Kind::kMap or token.kind == Kind::kArray) {
+		auto count = token.kind == Kind::kMap ? 2 * token.value : token.value;
+		for (; count != 0; --count) {
+			skip();
+		}
+	} else if (token.kind == Kind::kString or token.kind == Kind::kBinary or
+			token.kind == Kind::kExtension) {
+		static_cast<void>(readBytes(token.value));
+	}
+}
+
+std::string_view Reader::readRaw()
+{
+	auto first = pos_;
+	skip();
+	return input_.substr(first, pos_ - first);
+}
+
+void Reader::finish() const
+{
+	if (pos_ != input_.size()) {
+		fail("trailing bytes");
+	}
+}
+
+Reader::Position Reader::tell() const noexcept
+{
+	return pos_;
+}
+
+Reader Reader::fork(Position position) const
+{
+	Reader reader{input_};
+	reader.pos_ = position;
+	return reader;
+}
+
+void Reader::fail(char const *what) const
+{
+	throw ParseError{what, pos_};
+}
+
+Reader::Token Reader::readToken()
+{
+	auto type = static_cast<std::uint8_t>(readBigEndian(1));
+	if (type <= 0x7F) {
+		return {Kind::kUnsigned, type};
+	}
+	if (type >= 0xE0) {
+		return {
+			Kind::kSigned,
+			static_cast<std::uint64_t>(static_cast<std::int8_t>(type))
+		};
+	}
+	if ((type & 0xF0) == 0x80) {
+		return {Kind::kMap, type & 0x0Fu};
+	}
+	if ((type & 0xF0) == 0x90) {
+		return {Kind::kArray, type & 0x0Fu};
+	}
+	if ((type & 0xE0) == 0xA0) {
+		return {Kind::kString, type & 0x1Fu};
+	}
+	switch (type) {
+	case 0xC0:
+		return {Kind::kNil, 0};
+	case 0xC2:
+		return {Kind::kBoolean, 0};
+	case 0xC3:
+		return {Kind::kBoolean, 1};
+	case 0xC4:
+		return {Kind::kBinary, readBigEndian(1)};
+	case 0xC5:
+		return {Kind::kBinary, readBigEndian(2)};
+	case 0xC6:
+		return {Kind::kBinary, readBigEndian(4)};
+	// the length of an extension does not count its type byte
+	case 0xC7:
+		return {Kind::kExtension, readBigEndian(1) + 1};
+	case 0xC8:
+		return {Kind::kExtension, readBigEndian(2) + 1};
+	case 0xC9:
+		return {Kind::kExtension, readBigEndian(4) + 1};
+	case 0xCA: {
+		auto bits = static_cast<std::uint32_t>(readBigEndian(4));
+		return {
+			Kind::kFloat,
+			std::bit_cast<std::uint64_t>(
+				static_cast<double>(std::bit_cast<float>(bits))
+			)
+		};
+	}
+	case 0xCB:
+		return {Kind::kFloat, readBigEndian(8)};
+	case 0xCC:
+		return {Kind::kUnsigned, readBigEndian(1)};
+	case 0xCD:
+		return {Kind::kUnsigned, readBigEndian(2)};
+	case 0xCE:
+		return {Kind::kUnsigned, readBigEndian(4)};
+	case 0xCF:
+		return {Kind::kUnsigned, readBigEndian(8)};
+	case 0xD0:
+		return {
+			Kind::kSigned,
+			static_cast<std::uint64_t>(
+				static_cast<std::int8_t>(readBigEndian(1))
+			)
+		};
+	case 0xD1:
+		return {
+			Kind::kSigned,
+			static_cast<std::uint64_t>(
+				static_cast<std::int16_t>(readBigEndian(2))
+			)
+		};
+	case 0xD2:
+		return {
+			Kind::kSigned,
+			static_cast<std::uint64_t>(
+				static_cast<std::int32_t>(readBigEndian(4))
+			)
+		};
+	case 0xD3:
+		return {Kind::kSigned, readBigEndian(8)};
+	case 0xD4:
+		return {Kind::kExtension, 2};
+	case 0xD5:
+		return {Kind::kExtension, 3};
+	case 0xD6:
+		return {Kind::kExtension, 5};
+	case 0xD7:
+		return {Kind::kExtension, 9};
+	case 0xD8:
+		return {Kind::kExtension, 17};
+	case 0xD9:
+		return {Kind::kString, readBigEndian(1)};
+	case 0xDA:
+		return {Kind::kString, readBigEndian(2)};
+	case 0xDB:
+		return {Kind::kString, readBigEndian(4)};
+	case 0xDC:
+		return {Kind::kArray, readBigEndian(2)};
+	case 0xDD:
+		return {Kind::kArray, readBigEndian(4)};
+	case 0xDE:
+		return {Kind::kMap, readBigEndian(2)};
+	case 0xDF:
+		return {Kind::kMap, readBigEndian(4)};
+	default:
+		fail("invalid type");
+	}
+}
+
+Reader::Token Reader::readToken(Kind kind)
+{
+	auto token = readToken();
+	if (token.kind != kind) {
+		fail("unexpected type");
+	}
+	return token;
+}
+
+std::string_view Reader::readBytes(std::uint64_t size)
+{
+	if (size > input_.size() - pos_) {
+		fail("unexpected end of input");
+	}
+	auto bytes = input_.substr(pos_, size);
+	pos_ += size;
+	return bytes;
+}
+
+std::uint64_t Reader::readBigEndian(std::size_t size)
+{
+	std::uint64_t value{};
+	for (auto byte : readBytes(size)) {
+		value = value << 8 | static_cast<std::uint8_t>(byte);
+	}
+	return value;
+}
+
+json::Int Reader::toInteger(Token token) const
+{
+	if (token.kind == Kind::kSigned) {
+		return static_cast<json::Int>(token.value);
+	}
+	if (token.kind != Kind::kUnsigned or token.value >
+			static_cast<std::uint64_t>(std::numeric_limits<json::Int>::max())) {
+		fail("expected an integer");
+	}
+	return static_cast<json::Int>(token.value);
+}
+
+bool Reader::nextItem()
+{
+	if (remaining_.empty()) {
+		fail("not in a container");
+	}
+	if (remaining_.back() == 0) {
+		remaining_.pop_back();
+		return false;
+	}
+	--remaining_.back();
+	return true;
+}
+
+// Every item takes at least a byte, which bounds the size of containers
+// before anything is allocated for them
+json::view::Element Reader::readView(std::pmr::memory_resource &arena)
+{
+	auto token = readToken();
+	if (token.kind == Kind::kMap) {
+		using Member = json::view::Object::Member;
+		if (token.value > (input_.size() - pos_) / 2) {
+			fail("unexpected end of input");
+		}
+		auto *members = static_cast<Member *>(
+			arena.allocate(token.value * sizeof(Member), alignof(Member))
+		);
+		for (std::size_t i = 0; i != token.value; ++i) {
+			auto key = readString().raw();
+			std::construct_at(members + i, key, readView(arena));
+		}
+		auto size = json::view::sortMembers(members, token.value);
+		return json::view::Object{members, size};
+	}
+	if (token.kind == Kind::kArray) {
+		using Element = json::view::Element;
+		if (token.value > input_.size() - pos_) {
+			fail("unexpected end of input");
+		}
+		auto *elements = static_cast<Element *>(
+			arena.allocate(token.value * sizeof(Element), alignof(Element))
+		);
+		for (std::size_t i = 0; i != token.value; ++i) {
+			std::construct_at(elements + i, readView(arena));
+		}
+		return json::view::Array{elements, token.value};
+	}
+	if (token.kind == Kind::kString) {
+		return json::view::String{readBytes(token.value), false};
+	}
+	if (token.kind == Kind::kFloat) {
+		return std::bit_cast<double>(token.value);
+	}
+	if (token.kind == Kind::kBoolean) {
+		return token.value != 0;
+	}
+	return toInteger(token);
+}
+
+Writer::Writer(int fd)
+	: fd_{fd}
+{
+	buffer_.reserve(2 * kFlushSize);
+}
+
+Writer::Writer(Fork) noexcept
+	: fd_{-1}
+{
+}
+
+Writer::~Writer()
+{
+	try {
+		flush();
+	} catch (std::system_error const &) {
+	}
+}
+
+void Writer::beginObject(std::size_t size)
+{
+	if (size < 16) {
+		appendByte(static_cast<std::uint8_t>(0x80 | size));
+	} else {
+		appendLength(0xDE, size);
+	}
+}
+
+void Writer::endObject()
+{
+	finishValue();
+}
+
+void Writer::beginArray(std::size_t size)
+{
+	if (size < 16) {
+		appendByte(static_cast<std::uint8_t>(0x90 | size));
+	} else {
+		appendLength(0xDC, size);
+	}
+}
+
+void Writer::endArray()
+{
+	finishValue();
+}
+
+void Writer::writeKey(std::string_view key)
+{
+	writeString(key);
+}
+
+void Writer::writeString(std::string_view str)
+{
+	if (str.size() < 32) {
+		appendByte(static_cast<std::uint8_t>(0xA0 | str.size()));
+	} else if (str.size() <= 0xFF) {
+		appendByte(0xD9);
+		appendBigEndian(str.size(), 1);
+	} else {
+		appendLength(0xDA, str.size());
+	}
+	buffer_.append(str);
+	finishValue();
+}
+
+void Writer::writeInteger(json::Int number)
+{
+	auto bits = static_cast<std::uint64_t>(number);
+	if (number >= 0) {
+		if (number <= 0x7F) {
+			appendByte(static_cast<std::uint8_t>(number));
+		} else if (number <= 0xFF) {
+			appendByte(0xCC);
+			appendBigEndian(bits, 1);
+		} else if (number <= 0xFFFF) {
+			appendByte(0xCD);
+			appendBigEndian(bits, 2);
+		} else if (number <= 0xFFFF'FFFF) {
+			appendByte(0xCE);
+			appendBigEndian(bits, 4);
+		} else {
+			appendByte(0xCF);
+			appendBigEndian(bits, 8);
+		}
+	} else if (number >= -32) {
+		appendByte(static_cast<std::uint8_t>(bits));
+	} else if (number >= std::numeric_limits<std::int8_t>::min()) {
+		appendByte(0xD0);
+		appendBigEndian(bits, 1);
+	} else if (number >= std::numeric_limits<std::int16_t>::min()) {
+		appendByte(0xD1);
+		appendBigEndian(bits, 2);
+	} else if (number >= std::numeric_limits<std::int32_t>::min()) {
+		appendByte(0xD2);
+		appendBigEndian(bits, 4);
+	} else {
+		appendByte(0xD3);
+		appendBigEndian(bits, 8);
+	}
+	finishValue();
+}
+
+// Whole numbers are written as integers, as the JSON writer does,
+// and doubles that a float holds exactly as float 32
+void Writer::writeDouble(double number)
+{
+	constexpr double kIntegerLimit = 0x1p63;
+	auto const isSame = [](double lhs, double rhs) noexcept {
+		return std::bit_cast<std::uint64_t>(lhs) ==
+			std::bit_cast<std::uint64_t>(rhs);
+	};
+	if (number > -kIntegerLimit and number < kIntegerLimit) {
+		auto integer = static_cast<json::Int>(number);
+		if (isSame(static_cast<double>(integer), number)) {
+			writeInteger(integer);
+			return;
+		}
+	}
+	if (auto single = static_cast<float>(number);
+			isSame(static_cast<double>(single), number)) {
+		appendByte(0xCA);
+		appendBigEndian(std::bit_cast<std::uint32_t>(single), 4);
+	} else {
+		appendByte(0xCB);
+		appendBigEndian(std::bit_cast<std::uint64_t>(number), 8);
+	}
+	finishValue();
+}
+
+void Writer::writeBoolean(bool boolean)
+{
+	appendByte(boolean ? 0xC3 : 0xC2);
+	finishValue();
+}
+
+void Writer::writeElement(json::Element const &element)
+{
+	std::visit(utils::overloaded{
+		[this](json::Object const &object) {
+			beginObject(object.size());
+			for (auto const &[key, value] : object) {
+				writeKey(key);
+				writeElement(value);
+			}
+			endObject();
+		},
+		[this](json::Array const &array) {
+			beginArray(array.size());
+			for (auto const &value : array) {
+				writeElement(value);
+			}
+			endArray();
+		},
+		[this](std::string const &str) {
+			writeString(str);
+		},
+		[this](json::Int number) {
+			writeInteger(number);
+		},
+		[this](double number) {
+			writeDouble(number);
+		},
+		[this](bool boolean) {
+			writeBoolean(boolean);
+		},
+	}, element.getBase());
+}
+
+// The buffer is dropped even if writing fails
+void Writer::flush()
+{
+	if (fd_ < 0) {
+		return;
+	}
+	try {
+		utils::writeAll(fd_, buffer_);
+	} catch (...) {
+		buffer_.clear();
+		throw;
+	}
+	buffer_.clear();
+}
+
+Writer Writer::fork() const
+{
+	return Writer{Fork{}};
+}
+
+// The size of the enclosing container is already written,
+// so the values are simply appended
+void Writer::join(Writer const &fork)
+{
+	buffer_.append(fork.buffer_);
+	finishValue();
+}
+
+void Writer::appendByte(std::uint8_t byte)
+{
+	buffer_.push_back(static_cast<char>(byte));
+}
+
+void Writer::appendBigEndian(std::uint64_t value, std::size_t size)
+{
+	for (auto shift = 8 * size; shift != 0; ) {
+		shift -= 8;
+		appendByte(static_cast<std::uint8_t>(value >> shift));
+	}
+}
+
+void Writer::appendLength(std::uint8_t type, std::size_t length)
+{
+	if (length <= 0xFFFF) {
+		appendByte(type);
+		appendBigEndian(length, 2);
+	} else {
+		appendByte(static_cast<std::uint8_t>(type + 1));
+		appendBigEndian(length, 4);
+	}
+}
+
+void Writer::finishValue()
+{
+	if (buffer_.size() >= kFlushSize and fd_ >= 0) {
+		flush();
+	}
+}
+
+} // namespace msgpack
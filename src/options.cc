@@ -0,0 +1,125 @@
+#include <charconv>
+#include <span>
+#include <stdexcept>
+#include <string>
+
+#include "options.h"
+
+namespace options {
+
+namespace {
+
+// Returns true and sets the value if arg is "<name>=<value>"
+[[nodiscard]] bool parseValue(std::string_view arg, std::string_view name,
+	std::string &value)
+{
+	if (not arg.starts_with(name) or arg.size() == name.size() or
+			arg[name.size()] != '=') {
+		return false;
+	}
+	value = arg.substr(name.size() + 1);
+	return true;
+}
+
+// throws std::invalid_argument unless the whole value is a number
+[[nodiscard]] std::size_t parseSize(std::string const &value)
+{
+	std::size_t size{};
+	auto const *end = value.data() + value.size();
+	auto [last, error] = std::from_chars(value.data(), end, size);
+	if (error != std::errc{} or last != end) {
+		throw std::invalid_argument{"invalid size " + value};
+	}
+	return size;
+}
+
+} // namespace options::anonymous
+
+Options parseOptions(int argc, char const *const argv[])
+{
+	Options options;
+	std::string format;
+	std::string route_cache_size;
+	std::string workers_count;
+	std::string network_memory;
+	for (std::string_view arg : std::span{argv + 1, argv + argc}) {
+		if (parseValue(arg, "--format", format)) {
+			if (format == "json") {
+				options.format = Format::kJson;
+			} else if (format == "msgpack") {
+				options.format = Format::kMessagePack;
+			} else {
+				throw std::invalid_argument{"unknown format " + format};
+			}
+		} else if (arg == "--memory-report") {
+			options.memory_report = true;
+		} else if (arg == "--request-stats") {
+			options.request_stats = true;
+		} else if (arg == "--shortest-doubles") {
+			options.shortest_doubles = true;
+		} else if (arg == "--serve") {
+			options.serve = true;
+		} else if (arg == "--pipeline") {
+			options.pipeline = true;
+		} else if (parseValue(arg, "--route-cache", route_cache_size)) {
+			options.route_cache_size = parseSize(route_cache_size);
+		} else if (parseValue(arg, "--workers", workers_count)) {
+			options.workers_count = parseSize(workers_count);
+		} else if (parseValue(arg, "--network-memory", network_memory)) {
+			options.network_memory = parseSize(network_memory);
+		} else if (not parseValue(arg, "--save-snapshot",
+				options.save_snapshot) and
+			not parseValue(arg, "--load-snapshot", options.load_snapshot) and
+			not parseValue(arg, "--listen", options.listen) and
+			not parseValue(arg, "--base", options.base) and
+			not parseValue(arg, "--networks", options.networks) and
+			not parseValue(arg, "--connect", options.connect) and
+			not parseValue(arg, "--batch", options.batch)) {
+			throw std::invalid_argument{
+				"unknown option " + std::string{arg}
+			};
+		}
+	}
+	if (not options.save_snapshot.empty() and
+			not options.load_snapshot.empty()) {
+		throw std::invalid_argument{
+			"--save-snapshot and --load-snapshot are mutually exclusive"
+		};
+	}
+	if ((not options.base.empty() or not options.networks.empty()) and
+			options.listen.empty()) {
+		throw std::invalid_argument{
+			"--base and --networks are only for --listen"
+		};
+	}
+	if (options.pipeline and not options.serve) {
+		throw std::invalid_argument{"--pipeline is only for --serve"};
+	}
+	if (not options.base.empty() and not options.load_snapshot.empty()) {
+		throw std::invalid_argument{
+			"--base and --load-snapshot are mutually exclusive"
+		};
+	}
+	auto modes_count = static_cast<int>(options.serve) +
+		static_cast<int>(not options.listen.empty()) +
+		static_cast<int>(not options.connect.empty());
+	if (modes_count + static_cast<int>(not options.batch.empty()) > 1) {
+		throw std::invalid_argument{
+			"--serve, --listen, --connect and --batch are mutually exclusive"
+		};
+	}
+	if (not options.batch.empty() and (not options.save_snapshot.empty() or
+			not options.load_snapshot.empty())) {
+		throw std::invalid_argument{
+			"--batch builds the network of each input, with no snapshot"
+		};
+	}
+	if (modes_count != 0 and options.format != Format::kJson) {
+		throw std::invalid_argument{
+			"--serve, --listen and --connect take only json"
+		};
+	}
+	return options;
+}
+
+} // namespace options
@@ -1,11 +1,19 @@
-#include <string>
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include <stdexcept>
 #include <string_view>
-#include <unordered_map>
-#include <variant>
+#include <utility>
+#include <vector>
 
+#include "json_view.h"
+#include "json_writer.h"
+#include "msgpack.h"
 #include "request.h"
+#include "utils.h"
+#include "utils_memory.h"
+#include "utils_thread_pool.h"
 
-using json::Array;
 using json::Int;
 using json::Object;
 
@@ -13,162 +21,582 @@ namespace request {
 
 namespace {
 
-[[nodiscard]] Object
-	processBus(Object const &, transport::TransportDirectory const &);
-[[nodiscard]] Object
-	processStop(Object const &, transport::TransportDirectory const &);
-[[nodiscard]] Object
-	processRoute(Object const &, transport::TransportDirectory const &);
-[[nodiscard]] Object
-	processMap(Object const &, transport::TransportDirectory const &);
+template <typename Writer>
+void processBus(transport::Id bus, json::Element const &id,
+	transport::TransportDirectory const &, Writer &);
+template <typename Writer>
+void processStop(transport::Id stop, json::Element const &id,
+	transport::TransportDirectory const &, Writer &);
+template <typename Writer>
+void processRoute(transport::Id from, transport::Id to,
+	json::Element const &id, transport::TransportDirectory const &, Writer &,
+	RouteCache<Writer> *, std::uint32_t cache_tag, Metrics &);
+template <typename Writer>
+void processMap(json::Element const &id,
+	transport::TransportDirectory const &, Writer &);
+template <typename Writer>
+void processStats(json::Element const &id,
+	transport::TransportDirectory const &, Writer &);
+
+[[nodiscard]] json::Object describeHistogram(utils::HistogramSummary const &);
+
+[[nodiscard]] std::size_t estimateCost(Query) noexcept;
+[[nodiscard]] std::vector<std::size_t> splitByCost(Queries const &);
+
+template <typename Writer, typename WriteItems>
+void writeRoute(double total_time, json::Element const &id, Writer &,
+	WriteItems const &);
+template <typename Writer>
+void writeRouteItems(transport::info::Route::Items const &, Writer &);
+template <typename Writer>
+void writeRequestId(json::Element const &, Writer &);
+template <typename Writer>
+void writeNotFound(json::Element const &, Writer &);
+
+constinit Metrics process_metrics;
 
 } // namespace request::anonymous
 
-Object process(Object const &node,
+Metrics &getMetrics() noexcept
+{
+	return process_metrics;
+}
+
+// "type" may come last, so the fields of every type are kept until
+// the object ends. The id may be any value, it is only echoed back
+template <typename Reader>
+Request readRequest(Reader &reader)
+{
+	json::Element id;
+	json::view::String type;
+	std::string name;
+	std::string from;
+	std::string to;
+	std::string network;
+	reader.enterObject();
+	for (json::view::String key; reader.nextMember(key); ) {
+		if (key == "id") {
+			id = reader.readElement();
+		} else if (key == "type") {
+			type = reader.readString();
+		} else if (key == "name") {
+			name = reader.readString().decode();
+		} else if (key == "from") {
+			from = reader.readString().decode();
+		} else if (key == "to") {
+			to = reader.readString().decode();
+		} else if (key == "network") {
+			network = reader.readString().decode();
+		} else {
+			reader.skip();
+		}
+	}
+	if (type == "Bus") {
+		return {std::move(id), Bus{std::move(name)}, std::move(network)};
+	}
+	if (type == "Stop") {
+		return {std::move(id), Stop{std::move(name)}, std::move(network)};
+	}
+	if (type == "Route") {
+		return {
+			std::move(id), Route{std::move(from), std::move(to)},
+			std::move(network)
+		};
+	}
+	if (type == "Map") {
+		return {std::move(id), Map{}, std::move(network)};
+	}
+	if (type == "Stats") {
+		return {std::move(id), Stats{}, std::move(network)};
+	}
+	throw std::out_of_range{"request: unknown type"};
+}
+
+template <typename Reader>
+Requests readRequests(Reader &reader)
+{
+	Requests requests;
+	reader.enterArray();
+	while (reader.nextElement()) {
+		requests.push_back(readRequest(reader));
+	}
+	return requests;
+}
+
+std::size_t computeMemoryUsage(Requests const &requests) noexcept
+{
+	auto bytes = requests.capacity() * sizeof(Request);
+	for (auto const &request : requests) {
+		bytes += json::computeHeapUsage(request.id);
+		bytes += utils::getHeapBytes(request.network);
+		bytes += std::visit(utils::overloaded{
+			[](Bus const &query) noexcept {
+				return utils::getHeapBytes(query.name);
+			},
+			[](Stop const &query) noexcept {
+				return utils::getHeapBytes(query.name);
+			},
+			[](Route const &query) noexcept {
+				return utils::getHeapBytes(query.from) +
+					utils::getHeapBytes(query.to);
+			},
+			[](auto const &) noexcept {
+				return std::size_t{};
+			},
+		}, request.query);
+	}
+	return bytes;
+}
+
+Query resolve(Request const &request,
 	transport::TransportDirectory const &directory)
 {
-	static std::unordered_map<std::string_view, decltype(&process)> const
-	processor = {
-		{"Bus",		processBus},
-		{"Stop",	processStop},
-		{"Route",	processRoute},
-		{"Map",		processMap},
-	};
-	return processor.at(node.at("type").asString())(node, directory);
+	constexpr Query kNotFound{Query::Type::kNotFound, {}, {}};
+	return std::visit(utils::overloaded{
+		[&](Bus const &query) {
+			auto bus = directory.findBus(query.name);
+			return bus ? Query{Query::Type::kBus, *bus, {}} : kNotFound;
+		},
+		[&](Stop const &query) {
+			auto stop = directory.findStop(query.name);
+			return stop ? Query{Query::Type::kStop, *stop, {}} : kNotFound;
+		},
+		[&](Route const &query) {
+			auto from = directory.findStop(query.from);
+			auto to = directory.findStop(query.to);
+			return from and to ?
+				Query{Query::Type::kRoute, *from, *to} :
+				kNotFound;
+		},
+		[](Map const &) noexcept {
+			return Query{Query::Type::kMap, {}, {}};
+		},
+		[](Stats const &) noexcept {
+			return Query{Query::Type::kStats, {}, {}};
+		},
+	}, request.query);
 }
 
-Array processAll(Array const &nodes,
+Queries resolveAll(Requests const &requests,
 	transport::TransportDirectory const &directory)
 {
-	Array responses;
-	responses.reserve(nodes.size());
-	for (auto const &node : nodes) {
-		responses.emplace_back(process(node.asObject(), directory));
+	Queries queries;
+	queries.reserve(requests.size());
+	for (auto const &request : requests) {
+		queries.push_back(resolve(request, directory));
 	}
-	return responses;
+	return queries;
 }
 
-namespace {
+template <typename Writer>
+void process(Query query, json::Element const &id,
+	transport::TransportDirectory const &directory, Writer &writer,
+	std::type_identity_t<RouteCache<Writer>> *cache, std::uint32_t cache_tag)
+{
+	using Clock = std::chrono::steady_clock;
+	auto &metrics = getMetrics();
+	auto start = Clock::now();
+	switch (query.type) {
+	case Query::Type::kBus:
+		processBus(query.first, id, directory, writer);
+		break;
+	case Query::Type::kStop:
+		processStop(query.first, id, directory, writer);
+		break;
+	case Query::Type::kRoute:
+		processRoute(query.first, query.second, id, directory, writer, cache,
+			cache_tag, metrics);
+		break;
+	case Query::Type::kMap:
+		processMap(id, directory, writer);
+		break;
+	case Query::Type::kStats:
+		processStats(id, directory, writer);
+		break;
+	case Query::Type::kNotFound:
+		writeNotFound(id, writer);
+		break;
+	default:
+		throw std::out_of_range{"request: unknown query type"};
+	}
+	auto time = std::chrono::duration_cast<std::chrono::nanoseconds>(
+		Clock::now() - start);
+	metrics.latencies[static_cast<std::size_t>(query.type)].record(
+		static_cast<std::uint64_t>(time.count()));
+}
 
-Object processBus(Object const &node,
-	transport::TransportDirectory const &directory)
+template <typename Writer>
+void process(Request const &request,
+	transport::TransportDirectory const &directory, Writer &writer,
+	std::type_identity_t<RouteCache<Writer>> *cache)
 {
-	Object response;
-	response.emplace("request_id", node.at("id"));
-	if (auto info = directory.getBus(node.at("name").asString())) {
-		response.emplace_hint(
-			response.begin(),
-			"curvature",
-			info->road_route_length / info->geo_route_length
-		);
-		response.emplace_hint(
-			response.end(),
-			"route_length",
-			static_cast<Int>(info->road_route_length)
-		);
-		response.emplace_hint(
-			response.end(),
-			"stop_count",
-			static_cast<Int>(info->stops_count)
-		);
-		response.emplace_hint(
-			response.end(),
-			"unique_stop_count",
-			static_cast<Int>(info->unique_stops_count)
-		);
-	} else {
-		response.emplace_hint(
-			response.begin(),
-			"error_message",
-			std::string{"not found"}
-		);
+	process(resolve(request, directory), request.id, directory, writer,
+		cache);
+}
+
+// The batch is cut into chunks of about the same cost, which the threads
+// of the pool take in turn as they get free. Each chunk is written to
+// a fork of the writer, and the forks are joined in order a window
+// at a time, so that only a window of the response is held in memory
+template <typename Writer>
+void processAll(Requests const &requests,
+	transport::TransportDirectory const &directory, Writer &writer,
+	std::type_identity_t<RouteCache<Writer>> *cache, std::uint32_t cache_tag)
+{
+	constexpr std::size_t kChunksPerThread = 4;
+	auto queries = resolveAll(requests, directory);
+	auto &pool = utils::getThreadPool();
+	writer.beginArray(requests.size());
+	if (pool.size() == 0) {
+		for (std::size_t i = 0; i != queries.size(); ++i) {
+			process(queries[i], requests[i].id, directory, writer, cache,
+				cache_tag);
+		}
+		writer.endArray();
+		return;
 	}
-	return response;
+
+	auto bounds = splitByCost(queries);
+	auto chunks_count = bounds.size() - 1;
+	auto window_size = kChunksPerThread * (pool.size() + 1);
+	std::vector<Writer> forks;
+	forks.reserve(window_size);
+	for (std::size_t window = 0; window < chunks_count; window += window_size) {
+		forks.clear();
+		while (forks.size() != std::min(window_size, chunks_count - window)) {
+			forks.push_back(writer.fork());
+		}
+		pool.parallelFor(forks.size(), 1,
+			[&](std::size_t first, std::size_t last) {
+				for (auto chunk = first; chunk != last; ++chunk) {
+					auto begin = bounds[window + chunk];
+					auto end = bounds[window + chunk + 1];
+					for (auto i = begin; i != end; ++i) {
+						process(queries[i], requests[i].id, directory,
+							forks[chunk], cache, cache_tag);
+					}
+				}
+			});
+		for (auto const &fork : forks) {
+			writer.join(fork);
+		}
+	}
+	writer.endArray();
 }
 
-Object processStop(Object const &node,
-	transport::TransportDirectory const &directory)
+template Request readRequest(json::Reader &);
+template Request readRequest(msgpack::Reader &);
+
+template Requests readRequests(json::Reader &);
+template Requests readRequests(msgpack::Reader &);
+
+template void process(Query, json::Element const &,
+	transport::TransportDirectory const &, json::Writer &,
+	RouteCache<json::Writer> *, std::uint32_t);
+template void process(Query, json::Element const &,
+	transport::TransportDirectory const &, msgpack::Writer &,
+	RouteCache<msgpack::Writer> *, std::uint32_t);
+
+template void process(Request const &,
+	transport::TransportDirectory const &, json::Writer &,
+	RouteCache<json::Writer> *);
+template void process(Request const &,
+	transport::TransportDirectory const &, msgpack::Writer &,
+	RouteCache<msgpack::Writer> *);
+
+template void processAll(Requests const &,
+	transport::TransportDirectory const &, json::Writer &,
+	RouteCache<json::Writer> *, std::uint32_t);
+template void processAll(Requests const &,
+	transport::TransportDirectory const &, msgpack::Writer &,
+	RouteCache<msgpack::Writer> *, std::uint32_t);
+
+template <typename Writer>
+void writeError(std::string_view message, json::Element const &id,
+	Writer &writer)
 {
-	Object response;
-	response.emplace("request_id", node.at("id"));
-	if (auto info = directory.getStop(node.at("name").asString())) {
-		auto &buses = response.emplace_hint(
-			response.begin(),
-			"buses",
-			std::in_place_type<Array>
-		)->second.asArray();
-
-		buses.reserve(info->buses.size());
-		for (auto bus : info->buses) {
-			buses.emplace_back(std::in_place_type<std::string>, bus);
+	writer.beginObject(2);
+	writer.writeKey("error_message");
+	writer.writeString(message);
+	writeRequestId(id, writer);
+	writer.endObject();
+}
+
+template void writeError(std::string_view, json::Element const &,
+	json::Writer &);
+template void writeError(std::string_view, json::Element const &,
+	msgpack::Writer &);
+
+Object describeMemoryUsage(transport::info::MemoryUsage const &usage)
+{
+	auto describe = [](transport::info::MemoryUsage::Entries const &entries) {
+		Object object;
+		for (auto const &[name, bytes] : entries) {
+			object.emplace(name, static_cast<Int>(bytes));
 		}
+		return object;
+	};
+	return {
+		{"peak_rss", describe(usage.peak_rss)},
+		{"structures", describe(usage.structures)},
+	};
+}
+
+Object describeCacheStats(utils::CacheStats const &stats)
+{
+	return {
+		{"bytes", static_cast<Int>(stats.bytes)},
+		{"entries", static_cast<Int>(stats.entries)},
+		{"evictions", static_cast<Int>(stats.evictions)},
+		{"hits", static_cast<Int>(stats.hits)},
+		{"misses", static_cast<Int>(stats.misses)},
+	};
+}
+
+// Only the types of queries answered are described
+Object describeMetrics(Metrics const &metrics)
+{
+	constexpr std::array<std::string_view, Query::kTypesCount> kTypeNames = {
+		"Bus", "Stop", "Route", "Map", "Stats", "NotFound",
+	};
+	Object latencies;
+	for (std::size_t i = 0; i != Query::kTypesCount; ++i) {
+		auto summary = metrics.latencies[i].summarize();
+		if (summary.count != 0) {
+			latencies.emplace(kTypeNames[i], describeHistogram(summary));
+		}
+	}
+	auto names_not_found = metrics.latencies[
+		static_cast<std::size_t>(Query::Type::kNotFound)
+	].summarize().count;
+	return {
+		{"latency", std::move(latencies)},
+		{"not_found", Object{
+			{"names", static_cast<Int>(names_not_found)},
+			{"routes", static_cast<Int>(
+				metrics.routes_not_found.load(std::memory_order_relaxed)
+			)},
+		}},
+		{"route_cache_hits", static_cast<Int>(
+			metrics.route_cache_hits.load(std::memory_order_relaxed)
+		)},
+	};
+}
+
+namespace {
+
+template <typename Writer>
+void processBus(transport::Id bus, json::Element const &id,
+	transport::TransportDirectory const &directory, Writer &writer)
+{
+	auto info = directory.getBus(bus);
+	writer.beginObject(5);
+	writer.writeKey("curvature");
+	writer.writeDouble(info.road_route_length / info.geo_route_length);
+	writeRequestId(id, writer);
+	writer.writeKey("route_length");
+	writer.writeInteger(static_cast<Int>(info.road_route_length));
+	writer.writeKey("stop_count");
+	writer.writeInteger(static_cast<Int>(info.stops_count));
+	writer.writeKey("unique_stop_count");
+	writer.writeInteger(static_cast<Int>(info.unique_stops_count));
+	writer.endObject();
+}
+
+template <typename Writer>
+void processStop(transport::Id stop, json::Element const &id,
+	transport::TransportDirectory const &directory, Writer &writer)
+{
+	auto info = directory.getStop(stop);
+	writer.beginObject(2);
+	writer.writeKey("buses");
+	writer.beginArray(info.buses.size());
+	for (auto bus : info.buses) {
+		writer.writeString(bus);
+	}
+	writer.endArray();
+	writeRequestId(id, writer);
+	writer.endObject();
+}
+
+// A route found in the cache is joined as it is. One that is not
+// is written to a fork to be cached first, if it missed before.
+// Stops with no way between them are cached too, so that the counters
+// only miss the pairs asked for the first and the second time
+template <typename Writer>
+void processRoute(transport::Id from, transport::Id to,
+	json::Element const &id, transport::TransportDirectory const &directory,
+	Writer &writer, RouteCache<Writer> *cache, std::uint32_t cache_tag,
+	Metrics &metrics)
+{
+	auto key = std::uint64_t{cache_tag} << 32 |
+		static_cast<std::uint32_t>(from) << 16 | to;
+	auto cached = cache ? cache->find(key) : nullptr;
+	if (cached) {
+		metrics.route_cache_hits.fetch_add(1, std::memory_order_relaxed);
 	} else {
-		response.emplace_hint(
-			response.begin(),
-			"error_message",
-			std::string{"not found"}
-		);
+		auto route = directory.getRoute(from, to);
+		if (not cache or not cache->admit(key)) {
+			if (not route) {
+				metrics.routes_not_found.fetch_add(1,
+					std::memory_order_relaxed);
+				writeNotFound(id, writer);
+				return;
+			}
+			writeRoute(route->total_time, id, writer, [&] {
+				writeRouteItems(route->items, writer);
+			});
+			return;
+		}
+		auto fresh = std::make_shared<CachedRoute<Writer>>();
+		if (route) {
+			fresh->items.emplace(writer.fork());
+			fresh->total_time = route->total_time;
+			writeRouteItems(route->items, *fresh->items);
+		}
+		cache->insert(key, fresh,
+			fresh->items ? fresh->items->getMemoryUsage() : 0);
+		cached = std::move(fresh);
+	}
+	if (not cached->items) {
+		metrics.routes_not_found.fetch_add(1, std::memory_order_relaxed);
+		writeNotFound(id, writer);
+		return;
 	}
-	return response;
+	writeRoute(cached->total_time, id, writer, [&] {
+		writer.join(*cached->items);
+	});
 }
 
-Object processRoute(Object const &node,
-	transport::TransportDirectory const &directory)
+template <typename Writer>
+void processMap(json::Element const &id,
+	transport::TransportDirectory const &directory, Writer &writer)
 {
-	Object response;
-	response.emplace("request_id", node.at("id"));
-	if (auto route = directory.getRoute(node.at("from").asString(),
-			node.at("to").asString())) {
-		response.emplace_hint(response.end(), "total_time", route->total_time);
-		auto &items =
-			response.emplace_hint(
-				response.begin(),
-				"items",
-				std::in_place_type<Array>
-			)->second.asArray();
-
-		items.reserve(2 * route->items.size());
-		for (auto const &item : route->items) {
-			auto &wait =
-				items.emplace_back(std::in_place_type<Object>).asObject();
-
-			wait.emplace("stop_name", std::string{item.stop_name});
-			wait.emplace_hint(wait.end(), "time", item.wait_time);
-			wait.emplace_hint(wait.end(), "type", std::string{"Wait"});
-
-			auto &bus =
-				items.emplace_back(std::in_place_type<Object>).asObject();
-
-			bus.emplace("bus", std::string{item.bus_name});
-			bus.emplace_hint(
-				bus.end(),
-				"span_count",
-				static_cast<Int>(item.spans_count)
-			);
-			bus.emplace_hint(bus.end(), "time", item.travel_time);
-			bus.emplace_hint(bus.end(), "type", std::string{"Bus"});
+	writer.beginObject(2);
+	writer.writeKey("map");
+	writer.writeString(directory.getMap().data);
+	writeRequestId(id, writer);
+	writer.endObject();
+}
+
+template <typename Writer>
+void processStats(json::Element const &id,
+	transport::TransportDirectory const &directory, Writer &writer)
+{
+	writer.beginObject(3);
+	writer.writeKey("memory");
+	writer.writeElement(describeMemoryUsage(directory.getMemoryUsage()));
+	writeRequestId(id, writer);
+	writer.writeKey("requests");
+	writer.writeElement(describeMetrics(getMetrics()));
+	writer.endObject();
+}
+
+Object describeHistogram(utils::HistogramSummary const &summary)
+{
+	return {
+		{"count", static_cast<Int>(summary.count)},
+		{"max", static_cast<Int>(summary.max)},
+		{"mean", static_cast<Int>(summary.total / summary.count)},
+		{"p50", static_cast<Int>(summary.p50)},
+		{"p90", static_cast<Int>(summary.p90)},
+		{"p99", static_cast<Int>(summary.p99)},
+		{"p999", static_cast<Int>(summary.p999)},
+	};
+}
+
+// Relative costs of answering, a route being a path to assemble
+// and a map mostly a long string to copy
+std::size_t estimateCost(Query query) noexcept
+{
+	constexpr std::size_t kRouteCost = 8;
+	constexpr std::size_t kMapCost = 256;
+	switch (query.type) {
+	case Query::Type::kRoute:
+		return kRouteCost;
+	case Query::Type::kMap:
+		return kMapCost;
+	case Query::Type::kBus:
+	case Query::Type::kStop:
+	case Query::Type::kStats:
+	case Query::Type::kNotFound:
+	default:
+		return 1;
+	}
+}
+
+// The queries of chunk i are those from bounds[i] to bounds[i + 1]
+std::vector<std::size_t> splitByCost(Queries const &queries)
+{
+	constexpr std::size_t kChunkCost = 256;
+	std::vector<std::size_t> bounds{0};
+	std::size_t cost = 0;
+	for (std::size_t i = 0; i != queries.size(); ++i) {
+		cost += estimateCost(queries[i]);
+		if (cost >= kChunkCost) {
+			bounds.push_back(i + 1);
+			cost = 0;
 		}
-	} else {
-		response.emplace_hint(
-			response.begin(),
-			"error_message",
-			std::string{"not found"}
-		);
 	}
-	return response;
+	if (bounds.back() != queries.size()) {
+		bounds.push_back(queries.size());
+	}
+	return bounds;
 }
 
-Object processMap(Object const &node,
-	transport::TransportDirectory const &directory)
+template <typename Writer, typename WriteItems>
+void writeRoute(double total_time, json::Element const &id, Writer &writer,
+	WriteItems const &write_items)
+{
+	writer.beginObject(3);
+	writer.writeKey("items");
+	write_items();
+	writeRequestId(id, writer);
+	writer.writeKey("total_time");
+	writer.writeDouble(total_time);
+	writer.endObject();
+}
+
+template <typename Writer>
+void writeRouteItems(transport::info::Route::Items const &items,
+	Writer &writer)
+{
+	writer.beginArray(2 * items.size());
+	for (auto const &item : items) {
+		writer.beginObject(3);
+		writer.writeKey("stop_name");
+		writer.writeString(item.stop_name);
+		writer.writeKey("time");
+		writer.writeDouble(item.wait_time);
+		writer.writeKey("type");
+		writer.writeString("Wait");
+		writer.endObject();
+
+		writer.beginObject(4);
+		writer.writeKey("bus");
+		writer.writeString(item.bus_name);
+		writer.writeKey("span_count");
+		writer.writeInteger(static_cast<Int>(item.spans_count));
+		writer.writeKey("time");
+		writer.writeDouble(item.travel_time);
+		writer.writeKey("type");
+		writer.writeString("Bus");
+		writer.endObject();
+	}
+	writer.endArray();
+}
+
+template <typename Writer>
+void writeRequestId(json::Element const &id, Writer &writer)
+{
+	writer.writeKey("request_id");
+	writer.writeElement(id);
+}
+
+template <typename Writer>
+void writeNotFound(json::Element const &id, Writer &writer)
 {
-	Object response;
-	response.emplace("request_id", node.at("id"));
-	response.emplace_hint(
-		response.begin(),
-		"map",
-		std::string{directory.getMap().data}
-	);
-	return response;
+	writeError("not found", id, writer);
 }
 
 } // namespace request::anonymous
@@ -0,0 +1,267 @@
+#include <algorithm>
+#include <deque>
+#include <exception>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "json_view.h"
+#include "server.h"
+
+namespace server {
+
+namespace {
+
+using LineQueues = std::deque<utils::SpscQueue<std::string>>;
+using AnswerQueues = std::deque<utils::SpscQueue<json::Writer>>;
+
+[[nodiscard]] bool isBlank(std::string_view line) noexcept;
+
+void readQueued(utils::LineReader &lines, LineQueues &queues);
+
+void answerQueued(utils::SpscQueue<std::string> &lines,
+	utils::SpscQueue<json::Writer> &answers,
+	transport::TransportDirectory const &, RouteCache *,
+	json::Writer::Doubles);
+
+void writeQueued(AnswerQueues &queues, int fd);
+
+void addStats(utils::QueueStats &total, utils::QueueStats const &stats);
+
+[[nodiscard]] json::Object describeQueueStats(utils::QueueStats const &);
+
+} // namespace server::anonymous
+
+std::optional<request::Request> readLine(std::string_view line,
+	json::Writer &writer)
+{
+	if (isBlank(line)) {
+		return std::nullopt;
+	}
+	try {
+		json::Reader reader{line};
+		auto request = request::readRequest(reader);
+		reader.finish();
+		return request;
+	} catch (std::exception const &e) {
+		writer.beginObject(1);
+		writer.writeKey("error_message");
+		writer.writeString(e.what());
+		writer.endObject();
+		writer.endLine();
+		return std::nullopt;
+	}
+}
+
+void answerLines(std::string_view lines,
+	transport::TransportDirectory const &directory, json::Writer &writer,
+	RouteCache *cache)
+{
+	while (not lines.empty()) {
+		auto end = lines.find('\n');
+		auto line = lines.substr(0, end);
+		lines.remove_prefix(end == lines.npos ? lines.size() : end + 1);
+		if (auto request = readLine(line, writer)) {
+			request::process(*request, directory, writer, cache);
+			writer.endLine();
+		}
+	}
+}
+
+void serveLines(utils::LineReader &lines,
+	transport::TransportDirectory const &directory, json::Writer &writer,
+	RouteCache *cache)
+{
+	while (auto line = lines.next()) {
+		answerLines(*line, directory, writer, cache);
+		if (not lines.hasLine()) {
+			writer.flush();
+		}
+	}
+	writer.flush();
+}
+
+// The first stage to fail closes all the queues, which stops the others
+PipelineStats servePipelined(utils::LineReader &lines, int output_fd,
+	transport::TransportDirectory const &directory, RouteCache *cache,
+	PipelineSettings const &settings)
+{
+	auto workers_count = std::max(settings.workers_count, std::size_t{1});
+	LineQueues line_queues;
+	AnswerQueues answer_queues;
+	for (std::size_t i = 0; i != workers_count; ++i) {
+		line_queues.emplace_back(settings.queue_capacity);
+		answer_queues.emplace_back(settings.queue_capacity);
+	}
+
+	std::mutex error_mutex;
+	std::exception_ptr error;
+	auto fail = [&]() noexcept {
+		{
+			std::lock_guard lock{error_mutex};
+			if (not error) {
+				error = std::current_exception();
+			}
+		}
+		for (auto &queue : line_queues) {
+			queue.close();
+		}
+		for (auto &queue : answer_queues) {
+			queue.close();
+		}
+	};
+
+	std::vector<std::thread> stages;
+	for (std::size_t i = 0; i != workers_count; ++i) {
+		stages.emplace_back([&, i] {
+			try {
+				answerQueued(line_queues[i], answer_queues[i], directory,
+					cache, settings.doubles);
+			} catch (...) {
+				fail();
+			}
+			answer_queues[i].close();
+		});
+	}
+	stages.emplace_back([&] {
+		try {
+			writeQueued(answer_queues, output_fd);
+		} catch (...) {
+			fail();
+		}
+	});
+	try {
+		readQueued(lines, line_queues);
+	} catch (...) {
+		fail();
+	}
+	for (auto &queue : line_queues) {
+		queue.close();
+	}
+	for (auto &stage : stages) {
+		stage.join();
+	}
+	if (error) {
+		std::rethrow_exception(error);
+	}
+
+	PipelineStats stats{.workers_count = workers_count, .lines{}, .answers{}};
+	for (std::size_t i = 0; i != workers_count; ++i) {
+		addStats(stats.lines, line_queues[i].getStats());
+		addStats(stats.answers, answer_queues[i].getStats());
+	}
+	return stats;
+}
+
+json::Object describePipelineStats(PipelineStats const &stats)
+{
+	return {
+		{"answers", describeQueueStats(stats.answers)},
+		{"lines", describeQueueStats(stats.lines)},
+		{"workers", static_cast<json::Int>(stats.workers_count)},
+	};
+}
+
+namespace {
+
+bool isBlank(std::string_view line) noexcept
+{
+	return line.find_first_not_of(" \t\r") == line.npos;
+}
+
+// Stops once a worker is gone
+void readQueued(utils::LineReader &lines, LineQueues &queues)
+{
+	std::size_t next = 0;
+	while (auto line = lines.next()) {
+		if (not queues[next].push(std::string{*line})) {
+			return;
+		}
+		next = (next + 1) % queues.size();
+	}
+}
+
+// Every line is answered, if only by nothing, to keep the turn
+void answerQueued(utils::SpscQueue<std::string> &lines,
+	utils::SpscQueue<json::Writer> &answers,
+	transport::TransportDirectory const &directory, RouteCache *cache,
+	json::Writer::Doubles doubles)
+{
+	while (auto line = lines.pop()) {
+		json::Writer answer{-1, doubles};
+		answerLines(*line, directory, answer, cache);
+		if (not answers.push(std::move(answer))) {
+			return;
+		}
+	}
+}
+
+// The first worker with nothing left ends the turn, as the lines
+// after it were never read
+void writeQueued(AnswerQueues &queues, int fd)
+{
+	std::string buffer;
+	auto flush = [&buffer, fd] {
+		if (not buffer.empty()) {
+			utils::writeAll(fd, buffer);
+			buffer.clear();
+		}
+	};
+	auto take = [&flush](utils::SpscQueue<json::Writer> &queue) {
+		if (auto answer = queue.tryPop()) {
+			return answer;
+		}
+		flush();
+		return queue.pop();
+	};
+	for (std::size_t next = 0;; next = (next + 1) % queues.size()) {
+		auto answer = take(queues[next]);
+		if (not answer) {
+			break;
+		}
+		buffer.append(answer->view());
+		if (buffer.size() >= json::Writer::kFlushSize) {
+			flush();
+		}
+	}
+	flush();
+}
+
+void addStats(utils::QueueStats &total, utils::QueueStats const &stats)
+{
+	total.pushed += stats.pushed;
+	total.total_size += stats.total_size;
+	total.max_size = std::max(total.max_size, stats.max_size);
+	total.full_waits += stats.full_waits;
+	total.full_wait_time += stats.full_wait_time;
+	total.empty_waits += stats.empty_waits;
+	total.empty_wait_time += stats.empty_wait_time;
+}
+
+json::Object describeQueueStats(utils::QueueStats const &stats)
+{
+	auto toMicroseconds = [](std::chrono::nanoseconds time) {
+		return json::Int{
+			std::chrono::duration_cast<std::chrono::microseconds>(time)
+				.count()
+		};
+	};
+	return {
+		{"empty_wait_time", toMicroseconds(stats.empty_wait_time)},
+		{"empty_waits", static_cast<json::Int>(stats.empty_waits)},
+		{"full_wait_time", toMicroseconds(stats.full_wait_time)},
+		{"full_waits", static_cast<json::Int>(stats.full_waits)},
+		{"max_size", static_cast<json::Int>(stats.max_size)},
+		{"mean_size", stats.pushed != 0 ?
+			static_cast<double>(stats.total_size) /
+				static_cast<double>(stats.pushed) :
+			0.0},
+		{"pushed", static_cast<json::Int>(stats.pushed)},
+	};
+}
+
+} // namespace server::anonymous
+
+} // namespace server
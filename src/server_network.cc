@@ -0,0 +1,333 @@
+#include <exception>
+#include <stdexcept>
+#include <utility>
+
+#include "server_network.h"
+
+namespace server {
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+[[nodiscard]] Clock::rep getNow() noexcept;
+[[nodiscard]] std::uint32_t makeCacheTag() noexcept;
+
+} // namespace server::anonymous
+
+struct NetworkSlot::Counters {
+	void recordReclaim(Clock::rep delay) noexcept;
+
+	std::atomic<std::size_t> reclaimed_count{0};
+	std::atomic<Clock::rep> last_swap{0};
+	std::atomic<Clock::rep> max_reclaim_delay{0};
+};
+
+struct NetworkRegistry::Entry {
+	std::string path;
+	// held while the network is loaded, so that it is loaded once
+	std::mutex load_mutex;
+	// guards the slot and the error
+	mutable std::mutex mutex;
+	// nothing while the network is not loaded
+	std::unique_ptr<NetworkSlot> slot;
+	// why the network could not be loaded
+	std::string error;
+	std::atomic<Clock::rep> last_used{0};
+};
+
+Network::Network(transport::TransportDirectory &&built, RouteCache &cache,
+	std::uint64_t number)
+	: directory{std::move(built)}
+	, route_cache{&cache}
+	, cache_tag{makeCacheTag()}
+	, generation{number}
+{
+}
+
+NetworkSlot::NetworkSlot(transport::TransportDirectory &&directory,
+	RouteCache &route_cache)
+	: route_cache_{route_cache}
+	, counters_{std::make_shared<Counters>()}
+	, current_{makeNetwork(std::move(directory))}
+{
+}
+
+std::shared_ptr<Network const> NetworkSlot::get() const
+{
+	std::lock_guard lock{mutex_};
+	return current_;
+}
+
+// The old network is dropped here, and destroyed right away
+// if nobody uses it
+void NetworkSlot::publish(transport::TransportDirectory &&directory)
+{
+	auto network = makeNetwork(std::move(directory));
+	auto start = getNow();
+	{
+		std::lock_guard lock{mutex_};
+		current_.swap(network);
+	}
+	auto now = getNow();
+	counters_->last_swap.store(now - start, std::memory_order_relaxed);
+	network->replaced_at.store(now, std::memory_order_relaxed);
+}
+
+NetworkStats NetworkSlot::getStats() const noexcept
+{
+	auto const &counters = *counters_;
+	return {
+		.generation = generation_.load(std::memory_order_relaxed),
+		.reclaimed_count =
+			counters.reclaimed_count.load(std::memory_order_relaxed),
+		.last_swap = std::chrono::nanoseconds{
+			counters.last_swap.load(std::memory_order_relaxed)
+		},
+		.max_reclaim_delay = std::chrono::nanoseconds{
+			counters.max_reclaim_delay.load(std::memory_order_relaxed)
+		},
+	};
+}
+
+std::shared_ptr<Network const> NetworkSlot::makeNetwork(
+	transport::TransportDirectory &&directory)
+{
+	auto generation = generation_.fetch_add(1, std::memory_order_relaxed) + 1;
+	return {
+		new Network{std::move(directory), route_cache_, generation},
+		[counters = counters_](Network const *network) noexcept {
+			auto replaced_at = network->replaced_at.load(
+				std::memory_order_relaxed);
+			if (replaced_at != 0) {
+				counters->recordReclaim(getNow() - replaced_at);
+			}
+			delete network;
+		}
+	};
+}
+
+NetworkRegistry::NetworkRegistry(RouteCache &route_cache,
+	std::size_t memory_budget, Load load)
+	: route_cache_{route_cache}
+	, memory_budget_{memory_budget}
+	, load_{std::move(load)}
+{
+}
+
+NetworkRegistry::~NetworkRegistry() = default;
+
+void NetworkRegistry::setDefault(transport::TransportDirectory &&directory)
+{
+	default_.emplace(std::move(directory), route_cache_);
+}
+
+void NetworkRegistry::add(std::string name, std::string path)
+{
+	auto entry = std::make_unique<Entry>();
+	entry->path = std::move(path);
+	entries_.insert_or_assign(std::move(name), std::move(entry));
+}
+
+std::shared_ptr<Network const> NetworkRegistry::get(std::string_view name)
+{
+	if (name.empty()) {
+		return default_ ? default_->get() : nullptr;
+	}
+	auto it = entries_.find(name);
+	if (it == entries_.end()) {
+		return nullptr;
+	}
+	auto &entry = *it->second;
+	entry.last_used.store(getNow(), std::memory_order_relaxed);
+	auto find = [&entry]() -> std::shared_ptr<Network const> {
+		std::lock_guard lock{entry.mutex};
+		if (not entry.error.empty()) {
+			throw std::runtime_error{entry.error};
+		}
+		return entry.slot ? entry.slot->get() : nullptr;
+	};
+	if (auto loaded = find()) {
+		return loaded;
+	}
+
+	std::shared_ptr<Network const> network;
+	{
+		std::lock_guard loading{entry.load_mutex};
+		if (auto loaded = find()) {
+			return loaded;
+		}
+		std::unique_ptr<NetworkSlot> slot;
+		try {
+			slot = std::make_unique<NetworkSlot>(load_(entry.path),
+				route_cache_);
+		} catch (std::exception const &e) {
+			std::lock_guard lock{entry.mutex};
+			entry.error = e.what();
+			failures_count_.fetch_add(1, std::memory_order_relaxed);
+			throw std::runtime_error{entry.error};
+		}
+		network = slot->get();
+		std::lock_guard lock{entry.mutex};
+		entry.slot = std::move(slot);
+	}
+	loads_count_.fetch_add(1, std::memory_order_relaxed);
+	evict(entry);
+	return network;
+}
+
+NetworkSlot *NetworkRegistry::getDefault() noexcept
+{
+	return default_ ? &*default_ : nullptr;
+}
+
+bool NetworkRegistry::hasNamed() const noexcept
+{
+	return not entries_.empty();
+}
+
+std::vector<std::string> NetworkRegistry::getLoadedNames() const
+{
+	std::vector<std::string> names;
+	for (auto const &[name, entry] : entries_) {
+		std::lock_guard lock{entry->mutex};
+		if (entry->slot or not entry->error.empty()) {
+			names.push_back(name);
+		}
+	}
+	return names;
+}
+
+// The network is loaded without the entry locked,
+// so that it is still used meanwhile
+std::optional<NetworkStats> NetworkRegistry::reload(std::string const &name)
+{
+	auto &entry = *entries_.at(name);
+	{
+		std::lock_guard lock{entry.mutex};
+		if (not entry.error.empty()) {
+			entry.error.clear();
+			return std::nullopt;
+		}
+		if (not entry.slot) {
+			return std::nullopt;
+		}
+	}
+	auto directory = load_(entry.path);
+	std::lock_guard lock{entry.mutex};
+	if (not entry.slot) {
+		return std::nullopt;
+	}
+	entry.slot->publish(std::move(directory));
+	return entry.slot->getStats();
+}
+
+RouteCache const &NetworkRegistry::getRouteCache() const noexcept
+{
+	return route_cache_;
+}
+
+RegistryStats NetworkRegistry::getStats() const
+{
+	std::size_t loaded_count = 0;
+	for (auto const &[name, entry] : entries_) {
+		std::lock_guard lock{entry->mutex};
+		if (entry->slot) {
+			++loaded_count;
+		}
+	}
+	return {
+		.networks_count = entries_.size(),
+		.loaded_count = loaded_count,
+		.loaded_bytes = loaded_bytes_.load(std::memory_order_relaxed),
+		.loads_count = loads_count_.load(std::memory_order_relaxed),
+		.failures_count = failures_count_.load(std::memory_order_relaxed),
+		.evictions_count = evictions_count_.load(std::memory_order_relaxed),
+	};
+}
+
+// Sizes are taken anew, as maps are rendered once asked for.
+// A network dropped is destroyed once no entry is locked
+void NetworkRegistry::evict(Entry const &kept)
+{
+	std::lock_guard evicting{evict_mutex_};
+	for (;;) {
+		std::size_t total = 0;
+		Entry *oldest = nullptr;
+		for (auto const &[name, entry] : entries_) {
+			std::lock_guard lock{entry->mutex};
+			if (not entry->slot) {
+				continue;
+			}
+			total += entry->slot->get()->directory.getMemoryUsage().total;
+			if (entry.get() != &kept and (not oldest or
+					entry->last_used.load(std::memory_order_relaxed) <
+						oldest->last_used.load(std::memory_order_relaxed))) {
+				oldest = entry.get();
+			}
+		}
+		loaded_bytes_.store(total, std::memory_order_relaxed);
+		if (total <= memory_budget_ or not oldest) {
+			return;
+		}
+		std::unique_ptr<NetworkSlot> dropped;
+		{
+			std::lock_guard lock{oldest->mutex};
+			dropped = std::move(oldest->slot);
+		}
+		evictions_count_.fetch_add(1, std::memory_order_relaxed);
+	}
+}
+
+json::Object describeNetworkStats(NetworkStats const &stats)
+{
+	return {
+		{"generation", static_cast<json::Int>(stats.generation)},
+		{"last_swap", json::Int{stats.last_swap.count()}},
+		{"max_reclaim_delay", json::Int{
+			std::chrono::duration_cast<std::chrono::microseconds>(
+				stats.max_reclaim_delay).count()
+		}},
+		{"reclaimed", static_cast<json::Int>(stats.reclaimed_count)},
+	};
+}
+
+json::Object describeRegistryStats(RegistryStats const &stats)
+{
+	return {
+		{"evictions", static_cast<json::Int>(stats.evictions_count)},
+		{"failures", static_cast<json::Int>(stats.failures_count)},
+		{"loaded", static_cast<json::Int>(stats.loaded_count)},
+		{"loaded_bytes", static_cast<json::Int>(stats.loaded_bytes)},
+		{"loads", static_cast<json::Int>(stats.loads_count)},
+		{"networks", static_cast<json::Int>(stats.networks_count)},
+	};
+}
+
+void NetworkSlot::Counters::recordReclaim(Clock::rep delay) noexcept
+{
+	reclaimed_count.fetch_add(1, std::memory_order_relaxed);
+	auto max = max_reclaim_delay.load(std::memory_order_relaxed);
+	while (delay > max and not max_reclaim_delay.compare_exchange_weak(
+			max, delay, std::memory_order_relaxed)) {
+	}
+}
+
+namespace {
+
+Clock::rep getNow() noexcept
+{
+	return Clock::now().time_since_epoch().count();
+}
+
+// Tags wrap around after 2^32 networks, by when the routes
+// of the first are long gone from the cache
+std::uint32_t makeCacheTag() noexcept
+{
+	static std::atomic<std::uint32_t> next_tag{0};
+	return next_tag.fetch_add(1, std::memory_order_relaxed);
+}
+
+} // namespace server::anonymous
+
+} // namespace server
@@ -0,0 +1,866 @@
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <csignal>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <variant>
+#include <vector>
+
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <pthread.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/signalfd.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "request.h"
+#include "server_socket.h"
+#include "utils.h"
+#include "utils_io.h"
+#include "utils_socket.h"
+
+namespace server {
+
+namespace {
+
+using ConnectionId = std::uint64_t;
+
+// the tags of the descriptors the loop waits on, connections come after
+constexpr std::uint64_t kListenerTag = 0;
+constexpr std::uint64_t kWakeTag = 1;
+constexpr std::uint64_t kSignalTag = 2;
+constexpr ConnectionId kFirstConnection = 3;
+
+constexpr std::size_t kReadSize = std::size_t{1} << 16;
+constexpr std::size_t kLinesPerJob = 64;
+// a client is not read from while this much of its work is not sent
+constexpr std::size_t kMaxLinesWaiting = 64 * kLinesPerJob;
+constexpr std::size_t kMaxOutputWaiting = std::size_t{4} << 20;
+constexpr std::size_t kMaxLineSize = std::size_t{16} << 20;
+
+// Lines of a client, read together by a worker.
+// Each line of a client has a sequence, in the order they came
+struct Job {
+	ConnectionId connection;
+	std::uint64_t sequence;
+	std::string lines;
+};
+
+// A request left to be answered after the lines it came with,
+// by the network that resolved it
+struct Deferred {
+	ConnectionId connection;
+	std::uint64_t sequence;
+	std::shared_ptr<Network const> network;
+	request::Query query;
+	json::Element id;
+};
+
+using Task = std::variant<Job, Deferred>;
+using Scheduler = utils::Scheduler<Task, kWorkKindsCount>;
+
+// the answers to the lines from the sequence on
+struct Answer {
+	ConnectionId connection;
+	std::uint64_t sequence;
+	std::size_t lines_count;
+	std::string text;
+};
+
+struct Connection {
+	utils::FileDescriptor socket;
+	// the start of a line that is not complete yet
+	std::string input;
+	std::string output;
+	std::size_t output_sent = 0;
+	// the sequences of the next line and of the answer to send next
+	std::uint64_t next_line = 0;
+	std::uint64_t next_answer = 0;
+	// answers done before those that are to be sent ahead of them
+	std::map<std::uint64_t, Answer> early_answers;
+	std::uint32_t events = 0;
+	bool is_input_ended = false;
+	bool is_broken = false;
+};
+
+class Server {
+public:
+	Server(SocketSettings const &, NetworkRegistry &);
+	Server(Server const &) = delete;
+	Server &operator=(Server const &) = delete;
+	~Server();
+
+	void run();
+
+	[[nodiscard]] SchedulerStats getStats() const;
+
+private:
+	void watch(int fd, std::uint64_t tag, std::uint32_t events);
+	void accept();
+	void receive(ConnectionId, Connection &);
+	void send(Connection &);
+	void submit(ConnectionId, Connection &, std::string_view lines);
+	void collectAnswers();
+	// waits for what the connection can do next, or closes it
+	void update(ConnectionId, Connection &);
+	void setAccepting(bool);
+	// true on a stop signal
+	[[nodiscard]] bool takeSignals();
+
+	void work();
+	void answerJob(Job const &, std::vector<Answer> &);
+	// Nothing if the request is answered by an error_message instead
+	[[nodiscard]] std::shared_ptr<Network const> findNetwork(
+		request::Request const &, json::Writer &);
+	void answerDeferred(Deferred const &, bool is_expired,
+		std::vector<Answer> &);
+	void defer(Work, Deferred &&, std::vector<Answer> &);
+
+	void requestReload();
+	void reload();
+	// publishes the network to the slot if it is built
+	void reloadNetwork(std::string const &description,
+		std::function<std::optional<NetworkStats>()> const &build);
+
+private:
+	SocketSettings const &settings_;
+	NetworkRegistry &networks_;
+
+	utils::FileDescriptor listener_;
+	utils::FileDescriptor epoll_;
+	utils::FileDescriptor wake_;
+	utils::FileDescriptor signals_;
+
+	std::unordered_map<ConnectionId, Connection> connections_;
+	ConnectionId next_connection_ = kFirstConnection;
+	bool is_accepting_ = true;
+
+	Scheduler scheduler_;
+
+	std::mutex answers_mutex_;
+	std::vector<Answer> answers_;
+
+	std::vector<std::thread> workers_;
+
+	std::mutex reload_mutex_;
+	std::condition_variable reload_requested_;
+	bool is_reload_requested_ = false;
+	bool is_stopping_ = false;
+	std::thread reloader_;
+};
+
+[[nodiscard]] Scheduler::Classes makeClasses(std::size_t workers_count);
+[[nodiscard]] Work classify(request::Query) noexcept;
+[[nodiscard]] sigset_t getServerSignals() noexcept;
+[[nodiscard]] std::int64_t toMilliseconds(
+	std::chrono::steady_clock::duration) noexcept;
+// stderr is written to directly, as std::cerr is not shared between threads
+void log(std::string const &message) noexcept;
+
+[[noreturn]] void fail(char const *what)
+{
+	throw std::system_error{errno, std::generic_category(), what};
+}
+
+void copyAll(int from, int to);
+
+} // namespace server::anonymous
+
+void blockServerSignals()
+{
+	auto signals = getServerSignals();
+	if (auto error = ::pthread_sigmask(SIG_BLOCK, &signals, nullptr)) {
+		throw std::system_error{error, std::generic_category(),
+			"pthread_sigmask"};
+	}
+}
+
+SchedulerStats listen(SocketSettings const &settings,
+	NetworkRegistry &networks)
+{
+	Server server{settings, networks};
+	server.run();
+	return server.getStats();
+}
+
+json::Object describeSchedulerStats(SchedulerStats const &stats)
+{
+	constexpr char const *kNames[kWorkKindsCount] = {"lines", "routes", "maps"};
+	auto toMicroseconds = [](std::chrono::nanoseconds time) noexcept {
+		return json::Int{
+			std::chrono::duration_cast<std::chrono::microseconds>(time)
+				.count()
+		};
+	};
+	json::Object description;
+	for (std::size_t i = 0; i != kWorkKindsCount; ++i) {
+		auto const &kind = stats[i];
+		auto taken_count = static_cast<std::chrono::nanoseconds::rep>(
+			std::max(kind.started + kind.expired, std::size_t{1}));
+		description.emplace(kNames[i], json::Object{
+			{"expired", static_cast<json::Int>(kind.expired)},
+			{"max_wait", toMicroseconds(kind.max_wait)},
+			{"mean_wait", toMicroseconds(kind.total_wait / taken_count)},
+			{"queued", static_cast<json::Int>(kind.queued)},
+			{"rejected", static_cast<json::Int>(kind.rejected)},
+			{"started", static_cast<json::Int>(kind.started)},
+		});
+	}
+	return description;
+}
+
+// The input is sent from a thread of its own, so that the answers
+// are always taken and the server never waits for them to be
+void connect(std::string const &address, int in_fd, int out_fd)
+{
+	std::signal(SIGPIPE, SIG_IGN);
+	auto socket = utils::connectTo(address);
+	std::exception_ptr error;
+	std::thread sender{[&socket, &error, in_fd] {
+		try {
+			copyAll(in_fd, socket.get());
+		} catch (std::system_error const &) {
+			error = std::current_exception();
+		}
+		::shutdown(socket.get(), SHUT_WR);
+	}};
+	try {
+		copyAll(socket.get(), out_fd);
+	} catch (std::system_error const &) {
+		::shutdown(socket.get(), SHUT_RDWR);
+		sender.join();
+		throw;
+	}
+	sender.join();
+	if (error) {
+		std::rethrow_exception(error);
+	}
+}
+
+namespace {
+
+Server::Server(SocketSettings const &settings, NetworkRegistry &networks)
+	: settings_{settings}
+	, networks_{networks}
+	, listener_{utils::listenAt(settings.address)}
+	, epoll_{::epoll_create1(EPOLL_CLOEXEC)}
+	, wake_{::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)}
+	, scheduler_{
+		makeClasses(std::max(settings.workers_count, std::size_t{1})),
+		std::max(settings.workers_count, std::size_t{1})
+	}
+{
+	if (epoll_.get() < 0 or wake_.get() < 0) {
+		fail("epoll");
+	}
+	auto signals = getServerSignals();
+	signals_ = utils::FileDescriptor{
+		::signalfd(-1, &signals, SFD_NONBLOCK | SFD_CLOEXEC)
+	};
+	if (signals_.get() < 0) {
+		fail("signalfd");
+	}
+	watch(listener_.get(), kListenerTag, EPOLLIN);
+	watch(wake_.get(), kWakeTag, EPOLLIN);
+	watch(signals_.get(), kSignalTag, EPOLLIN);
+
+	auto workers_count = std::max(settings.workers_count, std::size_t{1});
+	workers_.reserve(workers_count);
+	for (std::size_t i = 0; i != workers_count; ++i) {
+		workers_.emplace_back([this] { work(); });
+	}
+	if (settings.reload or networks.hasNamed()) {
+		reloader_ = std::thread{[this] { reload(); }};
+	}
+}
+
+// a reload in progress is waited for
+Server::~Server()
+{
+	scheduler_.stop();
+	for (auto &worker : workers_) {
+		worker.join();
+	}
+	if (reloader_.joinable()) {
+		{
+			std::lock_guard lock{reload_mutex_};
+			is_stopping_ = true;
+		}
+		reload_requested_.notify_one();
+		reloader_.join();
+	}
+	utils::unlinkAddress(settings_.address);
+}
+
+void Server::run()
+{
+	constexpr int kEventsCount = 64;
+	epoll_event events[kEventsCount];
+	for (;;) {
+		auto count = ::epoll_wait(epoll_.get(), events, kEventsCount, -1);
+		if (count < 0 and errno == EINTR) {
+			continue;
+		}
+		if (count < 0) {
+			fail("epoll_wait");
+		}
+		for (int i = 0; i != count; ++i) {
+			auto tag = events[i].data.u64;
+			if (tag == kListenerTag) {
+				accept();
+				continue;
+			}
+			if (tag == kWakeTag) {
+				collectAnswers();
+				continue;
+			}
+			if (tag == kSignalTag and takeSignals()) {
+				return;
+			}
+			if (tag == kSignalTag) {
+				continue;
+			}
+			auto it = connections_.find(tag);
+			if (it == connections_.end()) {
+				continue;
+			}
+			auto &connection = it->second;
+			if (events[i].events & (EPOLLERR | EPOLLHUP)) {
+				connection.is_broken = true;
+			}
+			if (events[i].events & EPOLLOUT) {
+				send(connection);
+			}
+			if (events[i].events & EPOLLIN) {
+				receive(tag, connection);
+			}
+			update(tag, connection);
+		}
+	}
+}
+
+SchedulerStats Server::getStats() const
+{
+	return scheduler_.getStats();
+}
+
+void Server::watch(int fd, std::uint64_t tag, std::uint32_t events)
+{
+	epoll_event event{};
+	event.events = events;
+	event.data.u64 = tag;
+	if (::epoll_ctl(epoll_.get(), EPOLL_CTL_ADD, fd, &event) != 0) {
+		fail("epoll_ctl");
+	}
+}
+
+// Without free descriptors the listener is not watched, clients wait
+// in the backlog until a connection is closed
+void Server::accept()
+{
+	for (;;) {
+		auto fd = ::accept4(listener_.get(), nullptr, nullptr,
+			SOCK_NONBLOCK | SOCK_CLOEXEC);
+		if (fd < 0 and errno == EINTR) {
+			continue;
+		}
+		if (fd < 0 and (errno == EMFILE or errno == ENFILE)) {
+			setAccepting(false);
+		}
+		if (fd < 0) {
+			return;
+		}
+		// fails harmlessly on a Unix domain socket
+		int yes = 1;
+		::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &yes, sizeof(yes));
+
+		auto id = next_connection_++;
+		auto &connection = connections_[id];
+		connection.socket = utils::FileDescriptor{fd};
+		connection.events = EPOLLIN;
+		watch(fd, id, EPOLLIN);
+	}
+}
+
+void Server::receive(ConnectionId id, Connection &connection)
+{
+	auto &input = connection.input;
+	auto old_size = input.size();
+	input.resize(old_size + kReadSize);
+	auto n = ::recv(connection.socket.get(), input.data() + old_size,
+		kReadSize, 0);
+	if (n < 0) {
+		input.resize(old_size);
+		if (errno != EAGAIN and errno != EINTR) {
+			connection.is_broken = true;
+		}
+		return;
+	}
+	input.resize(old_size + static_cast<std::size_t>(n));
+	if (n == 0) {
+		connection.is_input_ended = true;
+		if (not input.empty()) {
+			input.push_back('\n');
+		}
+	}
+
+	auto end = std::string_view{input}.substr(old_size).rfind('\n');
+	if (end == input.npos) {
+		connection.is_broken = input.size() > kMaxLineSize;
+		return;
+	}
+	end += old_size + 1;
+	submit(id, connection, std::string_view{input}.substr(0, end));
+	input.erase(0, end);
+}
+
+void Server::send(Connection &connection)
+{
+	auto &output = connection.output;
+	auto &sent = connection.output_sent;
+	while (sent != output.size()) {
+		auto n = ::send(connection.socket.get(), output.data() + sent,
+			output.size() - sent, MSG_NOSIGNAL);
+		if (n < 0 and errno == EINTR) {
+			continue;
+		}
+		if (n < 0 and errno == EAGAIN) {
+			break;
+		}
+		if (n < 0) {
+			connection.is_broken = true;
+			return;
+		}
+		sent += static_cast<std::size_t>(n);
+	}
+	if (sent == output.size()) {
+		output.clear();
+		sent = 0;
+	} else if (sent > output.size() / 2) {
+		output.erase(0, sent);
+		sent = 0;
+	}
+}
+
+// Lines are split into jobs, so that many of them sent at once
+// are answered by several workers. The queue of lines is not bounded,
+// as clients with many lines waiting are not read from
+void Server::submit(ConnectionId id, Connection &connection,
+	std::string_view lines)
+{
+	while (not lines.empty()) {
+		std::size_t end = 0;
+		std::size_t lines_count = 0;
+		for (; lines_count != kLinesPerJob and end != lines.size();
+				++lines_count) {
+			end = lines.find('\n', end) + 1;
+		}
+		static_cast<void>(scheduler_.push(
+			static_cast<std::size_t>(Work::kLines),
+			Job{id, connection.next_line, std::string{lines.substr(0, end)}}
+		));
+		connection.next_line += lines_count;
+		lines.remove_prefix(end);
+	}
+}
+
+void Server::collectAnswers()
+{
+	eventfd_t count{};
+	::eventfd_read(wake_.get(), &count);
+	std::vector<Answer> answers;
+	{
+		std::lock_guard lock{answers_mutex_};
+		answers.swap(answers_);
+	}
+
+	std::vector<ConnectionId> answered;
+	for (auto &answer : answers) {
+		auto it = connections_.find(answer.connection);
+		if (it == connections_.end()) {
+			continue;
+		}
+		auto &connection = it->second;
+		if (answer.sequence != connection.next_answer) {
+			connection.early_answers.emplace(answer.sequence,
+				std::move(answer));
+			continue;
+		}
+		connection.output += answer.text;
+		connection.next_answer += answer.lines_count;
+		auto &early = connection.early_answers;
+		while (not early.empty() and
+				early.begin()->first == connection.next_answer) {
+			connection.output += early.begin()->second.text;
+			connection.next_answer += early.begin()->second.lines_count;
+			early.erase(early.begin());
+		}
+		answered.push_back(answer.connection);
+	}
+
+	std::sort(answered.begin(), answered.end());
+	answered.erase(std::unique(answered.begin(), answered.end()),
+		answered.end());
+	for (auto id : answered) {
+		auto &connection = connections_.at(id);
+		send(connection);
+		update(id, connection);
+	}
+}
+
+void Server::update(ConnectionId id, Connection &connection)
+{
+	bool is_waiting = connection.next_answer != connection.next_line;
+	bool is_sending = connection.output_sent != connection.output.size();
+	if (connection.is_broken or (connection.is_input_ended and
+			not is_waiting and not is_sending)) {
+		// closing the socket takes it out of epoll
+		connections_.erase(id);
+		setAccepting(true);
+		return;
+	}
+
+	std::uint32_t events = 0;
+	if (not connection.is_input_ended and
+			connection.next_line - connection.next_answer < kMaxLinesWaiting and
+			connection.output.size() - connection.output_sent <
+				kMaxOutputWaiting) {
+		events |= EPOLLIN;
+	}
+	if (is_sending) {
+		events |= EPOLLOUT;
+	}
+	if (events == connection.events) {
+		return;
+	}
+	epoll_event event{};
+	event.events = events;
+	event.data.u64 = id;
+	if (::epoll_ctl(epoll_.get(), EPOLL_CTL_MOD, connection.socket.get(),
+			&event) != 0) {
+		fail("epoll_ctl");
+	}
+	connection.events = events;
+}
+
+void Server::setAccepting(bool is_accepting)
+{
+	if (is_accepting == is_accepting_) {
+		return;
+	}
+	epoll_event event{};
+	event.events = is_accepting ? std::uint32_t{EPOLLIN} : 0;
+	event.data.u64 = kListenerTag;
+	if (::epoll_ctl(epoll_.get(), EPOLL_CTL_MOD, listener_.get(),
+			&event) != 0) {
+		fail("epoll_ctl");
+	}
+	is_accepting_ = is_accepting;
+}
+
+bool Server::takeSignals()
+{
+	signalfd_siginfo info{};
+	while (::read(signals_.get(), &info, sizeof(info)) == sizeof(info)) {
+		if (info.ssi_signo != SIGHUP) {
+			return true;
+		}
+		requestReload();
+	}
+	return false;
+}
+
+void Server::work()
+{
+	while (auto pick = scheduler_.pop()) {
+		std::vector<Answer> answers;
+		std::visit(utils::overloaded{
+			[&](Job const &job) {
+				answerJob(job, answers);
+			},
+			[&](Deferred const &deferred) {
+				answerDeferred(deferred, pick->is_expired, answers);
+			},
+		}, pick->task);
+		scheduler_.finish(pick->class_index);
+		{
+			std::lock_guard lock{answers_mutex_};
+			for (auto &answer : answers) {
+				answers_.push_back(std::move(answer));
+			}
+		}
+		::eventfd_write(wake_.get(), 1);
+	}
+}
+
+// The lines answered right away are answered together, up to
+// each of those that are deferred. Lines in a row are mostly
+// for the same network, which is looked up once for them
+void Server::answerJob(Job const &job, std::vector<Answer> &answers)
+{
+	std::shared_ptr<Network const> network;
+	std::string network_name;
+	json::Writer writer{-1, settings_.doubles};
+	std::size_t answered_size = 0;
+	auto answered = job.sequence;
+	auto sequence = job.sequence;
+	auto addAnswered = [&] {
+		if (sequence != answered) {
+			answers.push_back({
+				job.connection, answered, sequence - answered,
+				std::string{writer.view().substr(answered_size)}
+			});
+		}
+		answered_size = writer.view().size();
+		answered = sequence + 1;
+	};
+
+	std::string_view lines = job.lines;
+	for (; not lines.empty(); ++sequence) {
+		auto end = lines.find('\n');
+		auto line = lines.substr(0, end);
+		lines.remove_prefix(end + 1);
+		auto request = readLine(line, writer);
+		if (not request) {
+			continue;
+		}
+		if (not network or request->network != network_name) {
+			network = findNetwork(*request, writer);
+			network_name = request->network;
+		}
+		if (not network) {
+			continue;
+		}
+		auto query = request::resolve(*request, network->directory);
+		auto work = classify(query);
+		if (work == Work::kLines) {
+			request::process(query, request->id, network->directory, writer,
+				network->route_cache, network->cache_tag);
+			writer.endLine();
+			continue;
+		}
+		addAnswered();
+		defer(work, {
+			job.connection, sequence, network, query, std::move(request->id)
+		}, answers);
+	}
+	addAnswered();
+}
+
+std::shared_ptr<Network const> Server::findNetwork(
+	request::Request const &request, json::Writer &writer)
+{
+	std::shared_ptr<Network const> network;
+	try {
+		network = networks_.get(request.network);
+		if (not network) {
+			request::writeError("unknown network", request.id, writer);
+		}
+	} catch (std::runtime_error const &e) {
+		request::writeError(e.what(), request.id, writer);
+	}
+	if (not network) {
+		writer.endLine();
+	}
+	return network;
+}
+
+void Server::answerDeferred(Deferred const &deferred, bool is_expired,
+	std::vector<Answer> &answers)
+{
+	json::Writer writer{-1, settings_.doubles};
+	if (is_expired) {
+		request::writeError("overloaded", deferred.id, writer);
+	} else {
+		auto const &network = *deferred.network;
+		request::process(deferred.query, deferred.id, network.directory,
+			writer, network.route_cache, network.cache_tag);
+	}
+	writer.endLine();
+	answers.push_back({
+		deferred.connection, deferred.sequence, 1, std::string{writer.view()}
+	});
+}
+
+// a request whose queue is full is answered right away
+void Server::defer(Work work, Deferred &&deferred,
+	std::vector<Answer> &answers)
+{
+	Task task{std::move(deferred)};
+	if (scheduler_.push(static_cast<std::size_t>(work), std::move(task))) {
+		return;
+	}
+	auto const &rejected = std::get<Deferred>(task);
+	json::Writer writer{-1, settings_.doubles};
+	request::writeError("overloaded", rejected.id, writer);
+	writer.endLine();
+	answers.push_back({
+		rejected.connection, rejected.sequence, 1, std::string{writer.view()}
+	});
+}
+
+void Server::requestReload()
+{
+	if (not reloader_.joinable()) {
+		log("SIGHUP ignored, no network can be reloaded\n");
+		return;
+	}
+	{
+		std::lock_guard lock{reload_mutex_};
+		is_reload_requested_ = true;
+	}
+	reload_requested_.notify_one();
+}
+
+// SIGHUP received while the networks are built starts another build
+// once they are published, so that the last one is taken. The default
+// network is built again by the settings, the named ones loaded
+// by the registry
+void Server::reload()
+{
+	for (;;) {
+		{
+			std::unique_lock lock{reload_mutex_};
+			reload_requested_.wait(lock, [this] {
+				return is_reload_requested_ or is_stopping_;
+			});
+			if (is_stopping_) {
+				return;
+			}
+			is_reload_requested_ = false;
+		}
+		if (auto *slot = networks_.getDefault(); slot and settings_.reload) {
+			reloadNetwork("default network", [this, slot] {
+				slot->publish(settings_.reload());
+				return std::optional{slot->getStats()};
+			});
+		}
+		for (auto const &name : networks_.getLoadedNames()) {
+			reloadNetwork("network " + name, [this, &name] {
+				return networks_.reload(name);
+			});
+		}
+	}
+}
+
+void Server::reloadNetwork(std::string const &description,
+	std::function<std::optional<NetworkStats>()> const &build)
+{
+	auto start = std::chrono::steady_clock::now();
+	try {
+		auto stats = build();
+		if (not stats) {
+			return;
+		}
+		auto time = std::chrono::steady_clock::now() - start;
+		log("reloaded " + description + " " +
+			std::to_string(stats->generation) + ": built in " +
+			std::to_string(toMilliseconds(time)) + " ms, swapped in " +
+			std::to_string(stats->last_swap.count()) + " ns\n");
+	} catch (std::exception const &e) {
+		log("reloading " + description + " failed: " + e.what() + '\n');
+	}
+}
+
+// Lines are taken first, and routes and maps leave a worker to them,
+// so that the cheap requests answered with the lines do not wait
+// behind the costly ones. Maps may take at most a quarter of the workers
+Scheduler::Classes makeClasses(std::size_t workers_count)
+{
+	using namespace std::chrono_literals;
+	auto workers_left = std::min(workers_count - 1, std::size_t{1});
+	Scheduler::Classes classes;
+	classes[static_cast<std::size_t>(Work::kLines)] = {
+		.weight = 16,
+	};
+	classes[static_cast<std::size_t>(Work::kRoutes)] = {
+		.weight = 4,
+		.max_queued = std::size_t{1} << 16,
+		.deadline = 2s,
+		.workers_left = workers_left,
+	};
+	classes[static_cast<std::size_t>(Work::kMaps)] = {
+		.weight = 1,
+		.max_queued = 256,
+		.deadline = 5s,
+		.max_running = std::max(workers_count / 4, std::size_t{1}),
+		.workers_left = workers_left,
+	};
+	return classes;
+}
+
+Work classify(request::Query query) noexcept
+{
+	switch (query.type) {
+	case request::Query::Type::kRoute:
+		return Work::kRoutes;
+	case request::Query::Type::kMap:
+		return Work::kMaps;
+	case request::Query::Type::kBus:
+	case request::Query::Type::kStop:
+	case request::Query::Type::kStats:
+	case request::Query::Type::kNotFound:
+	default:
+		return Work::kLines;
+	}
+}
+
+sigset_t getServerSignals() noexcept
+{
+	sigset_t signals;
+	sigemptyset(&signals);
+	sigaddset(&signals, SIGINT);
+	sigaddset(&signals, SIGTERM);
+	sigaddset(&signals, SIGHUP);
+	return signals;
+}
+
+std::int64_t toMilliseconds(std::chrono::steady_clock::duration time) noexcept
+{
+	return std::chrono::duration_cast<std::chrono::milliseconds>(time).count();
+}
+
+void log(std::string const &message) noexcept
+{
+	try {
+		utils::writeAll(STDERR_FILENO, message);
+	} catch (std::system_error const &) {
+	}
+}
+
+void copyAll(int from, int to)
+{
+	std::string buffer(kReadSize, '\0');
+	for (;;) {
+		auto n = ::read(from, buffer.data(), buffer.size());
+		if (n < 0 and errno == EINTR) {
+			continue;
+		}
+		if (n < 0) {
+			fail("read");
+		}
+		if (n == 0) {
+			return;
+		}
+		utils::writeAll(to, {buffer.data(), static_cast<std::size_t>(n)});
+	}
+}
+
+} // namespace server::anonymous
+
+} // namespace server
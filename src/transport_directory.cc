@@ -10,24 +10,52 @@ TransportDirectory::TransportDirectory(config::Config &&config)
 {
 }
 
+TransportDirectory::TransportDirectory(
+	std::unique_ptr<TransportDirectoryImpl> impl)
+	: impl_{std::move(impl)}
+{
+}
+
+TransportDirectory::TransportDirectory(TransportDirectory &&) noexcept =
+	default;
+
 TransportDirectory::~TransportDirectory() = default;
 
-std::optional<info::Bus> TransportDirectory::
-	getBus(std::string const &name) const
+TransportDirectory TransportDirectory::loadSnapshot(std::string const &path)
+{
+	return TransportDirectory{
+		std::make_unique<TransportDirectoryImpl>(utils::MappedFile{path})
+	};
+}
+
+void TransportDirectory::saveSnapshot(std::string const &path) const
+{
+	impl_->saveSnapshot(path);
+}
+
+std::optional<Id> TransportDirectory::findBus(std::string_view name) const
 {
-	return impl_->getBus(name);
+	return impl_->findBus(name);
 }
 
-std::optional<info::Stop> TransportDirectory::
-	getStop(std::string const &name) const
+std::optional<Id> TransportDirectory::findStop(std::string_view name) const
 {
-	return impl_->getStop(name);
+	return impl_->findStop(name);
 }
 
-std::optional<info::Route> TransportDirectory::
-	getRoute(std::string const &from, std::string const &to) const
+info::Bus TransportDirectory::getBus(Id id) const
 {
-	return impl_->getRoute(from, to);
+	return impl_->getBusInfo(id);
+}
+
+info::Stop TransportDirectory::getStop(Id id) const
+{
+	return impl_->getStopInfo(id);
+}
+
+std::optional<info::Route> TransportDirectory::getRoute(Id from, Id to) const
+{
+	return impl_->getRouteInfo(from, to);
 }
 
 info::Map TransportDirectory::getMap() const
@@ -35,4 +63,9 @@ info::Map TransportDirectory::getMap() const
 	return impl_->getMap();
 }
 
+info::MemoryUsage TransportDirectory::getMemoryUsage() const
+{
+	return impl_->getMemoryUsage();
+}
+
 } // namespace transport
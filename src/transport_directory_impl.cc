@@ -1,6 +1,7 @@
 #include <algorithm>
 #include <cmath>
 #include <limits>
+#include <mutex>
 #include <ranges>
 #include <stack>
 #include <utility>
@@ -9,13 +10,14 @@
 #include "geo_math.h"
 #include "transport_directory_impl.h"
 #include "transport_directory_renderer.h"
+#include "utils_thread_pool.h"
 
 namespace transport {
 
 using detail::Route;
 
 std::size_t TransportDirectoryImpl::
-	countUniqueId(std::vector<StopId> const &route) const
+	countUniqueId(std::span<StopId const> route) const
 {
 	std::vector ids(getStopsCount(), 0);
 	for (auto id : route) {
@@ -27,7 +29,7 @@ std::size_t TransportDirectoryImpl::
 }
 
 double TransportDirectoryImpl::
-	computeRoadRouteLength(std::vector<StopId> const &route) const noexcept
+	computeRoadRouteLength(std::span<StopId const> route) const noexcept
 {
 	double length{};
 	for (auto from = route.front(); auto to : route | std::views::drop(1)) {
@@ -37,7 +39,7 @@ double TransportDirectoryImpl::
 }
 
 double TransportDirectoryImpl::
-	computeGeoRouteLength(std::vector<StopId> const &route) const noexcept
+	computeGeoRouteLength(std::span<StopId const> route) const noexcept
 {
 	double length{};
 	for (auto from = route.front(); auto to : route | std::views::drop(1)) {
@@ -47,7 +49,7 @@ double TransportDirectoryImpl::
 }
 
 auto TransportDirectoryImpl::
-	computeRouteLengths(std::vector<StopId> const &route) const noexcept
+	computeRouteLengths(std::span<StopId const> route) const noexcept
 {
 	struct Lengths {
 		double road;
@@ -61,7 +63,16 @@ auto TransportDirectoryImpl::
 }
 
 TransportDirectoryImpl::TransportDirectoryImpl(config::Config &&config)
-	: routing_settings_{std::move(config.routing_settings)}
+	: arena_{estimateArenaSize(config.items), &arena_memory_}
+	, names_{computeNamesSize(config.items), &names_memory_}
+	, bus_ids_{&bus_ids_memory_}
+	, buses_{&buses_memory_}
+	, stop_ids_{&stop_ids_memory_}
+	, stops_{&stops_memory_}
+	, distances_{&distances_memory_}
+	, geo_distances_{&geo_distances_memory_}
+	, routes_{&routes_memory_}
+	, routing_settings_{std::move(config.routing_settings)}
 	, render_settings_{std::move(config.render_settings)}
 {
 	auto buses = std::ranges::partition(config.items,
@@ -70,23 +81,79 @@ TransportDirectoryImpl::TransportDirectoryImpl(config::Config &&config)
 		});
 	decltype(buses) stops = {config.items.begin(), buses.begin()};
 
+	recordPeakRss("config");
+
 	init(stops.size(), buses.size());
+	recordPeakRss("init");
 
-	for (auto &stop : stops) {
-		addStop(std::get<config::Stop>(std::move(stop)));
+	std::vector<bool> is_added(stops.size());
+	bool are_names_unique = true;
+	for (auto const &stop : stops) {
+		auto id = addStop(std::get<config::Stop>(stop));
+		are_names_unique = are_names_unique and not is_added[id];
+		is_added[id] = true;
 	}
-	for (auto &bus : buses) {
-		addBus(std::get<config::Bus>(std::move(bus)));
+	fillDistances({stops.begin(), stops.end()}, are_names_unique);
+	for (auto const &bus : buses) {
+		addBus(std::get<config::Bus>(bus));
 	}
+	recordPeakRss("registration");
 
 	calculateGeoDistances();
+	recordPeakRss("geo_distances");
+
 	computeRoutes();
+	recordPeakRss("routes");
+
+	computeBusesInfo();
+}
+
+void TransportDirectoryImpl::recordPeakRss(std::string_view phase)
+{
+	peak_rss_.push_back({.name = phase, .bytes = utils::getPeakRss()});
+}
+
+std::size_t TransportDirectoryImpl::
+	computeNamesSize(config::Items const &items) noexcept
+{
+	std::size_t size{};
+	for (auto const &item : items) {
+		size += std::visit([](auto const &value) noexcept {
+			return value.name.size();
+		}, item);
+	}
+	return size;
+}
+
+// Names, routes, lists of buses and name maps. The square tables
+// are not counted, each of them is a single block of known size
+std::size_t TransportDirectoryImpl::
+	estimateArenaSize(config::Items const &items) noexcept
+{
+	constexpr std::size_t kMapEntrySize = 4 * sizeof(void *);
+	auto size = computeNamesSize(items);
+	for (auto const &item : items) {
+		size += kMapEntrySize;
+		if (auto const *bus = std::get_if<config::Bus>(&item)) {
+			size += bus->route.size() * (sizeof(StopId) + sizeof(BusId));
+		}
+	}
+	return size;
 }
 
 void TransportDirectoryImpl::init(
 	std::size_t stops_count, std::size_t buses_count)
 {
-	stops_.resize(stops_count);
+	stop_ids_.reserve(stops_count);
+	stops_.reserve(stops_count);
+	for (std::size_t i = 0; i != stops_count; ++i) {
+		stops_.push_back({
+			.id = {},
+			.name = {},
+			.coords = {},
+			.buses = std::pmr::vector<BusId>{&stops_memory_},
+		});
+	}
 	geo_distances_.resize(stops_count * stops_count);
 	distances_.resize(
 		stops_count * stops_count,
@@ -96,79 +163,143 @@ void TransportDirectoryImpl::init(
 		.time = std::numeric_limits<double>::infinity(),
 		.item = {},
 	});
-	buses_.resize(buses_count);
+	bus_ids_.reserve(buses_count);
+	buses_.reserve(buses_count);
+	for (std::size_t i = 0; i != buses_count; ++i) {
+		buses_.push_back({
+			.id = {},
+			.name = {},
+			.route = std::pmr::vector<StopId>{&buses_memory_},
+			.is_roundtrip = {},
+			.info = {},
+		});
+	}
 }
 
-void TransportDirectoryImpl::addBus(config::Bus &&bus)
+void TransportDirectoryImpl::addBus(config::Bus const &bus)
 {
-	auto &new_bus = registerBus(std::move(bus.name));
+	auto &new_bus = registerBus(bus.name);
 	new_bus.route.reserve(bus.route.size());
-	for (auto &stop_name : bus.route) {
-		auto &stop = registerStop(std::move(stop_name));
+	for (auto const &stop_name : bus.route) {
+		auto &stop = registerStop(stop_name);
 		new_bus.route.push_back(stop.id);
-		stop.buses.insert(new_bus.id);
+		// buses are added one by one, so the list stays sorted by id
+		if (stop.buses.empty() or stop.buses.back() != new_bus.id) {
+			stop.buses.push_back(new_bus.id);
+		}
 	}
 	new_bus.is_roundtrip = bus.is_roundtrip;
 }
 
-void TransportDirectoryImpl::addStop(config::Stop &&stop)
+// Only assigns the ids, the distances are filled in by fillDistances
+TransportDirectoryImpl::StopId TransportDirectoryImpl::
+	addStop(config::Stop const &stop)
 {
-	auto &new_stop = registerStop(std::move(stop.name));
+	auto &new_stop = registerStop(stop.name);
 	new_stop.coords = stop.coords;
-	for (auto &[adjacent_name, distance] : stop.distances) {
-		auto &adjacent = registerStop(std::move(adjacent_name));
-		new_stop.adjacents.insert(adjacent.id);
-		getDistance(new_stop.id, adjacent.id) = distance;
-		if (adjacent.adjacents.insert(new_stop.id).second) {
-			getDistance(adjacent.id, new_stop.id) = distance;
-		}
+	for (auto const &adjacent : stop.distances) {
+		registerStop(adjacent.first);
 	}
+	return new_stop.id;
+}
+
+// The given distances are set first, and then the reverse ones that
+// are not given. Either way a stop only writes the entries of its own
+// row or column, so the stops are filled in parallel unless one of them
+// is given twice
+void TransportDirectoryImpl::fillDistances(
+	std::span<config::Item const> stops, bool are_names_unique)
+{
+	constexpr std::size_t kChunkSize = 64;
+	auto &pool = utils::getThreadPool();
+	auto chunk_size = are_names_unique ? kChunkSize : stops.size();
+	auto fill = [&](auto const &set) {
+		pool.parallelFor(stops.size(), chunk_size,
+			[&](std::size_t first, std::size_t last) {
+				for (auto i = first; i != last; ++i) {
+					auto const &stop = std::get<config::Stop>(stops[i]);
+					auto id = stop_ids_.find(stop.name)->second;
+					for (auto const &[adjacent_name, distance] :
+							stop.distances) {
+						set(id, stop_ids_.find(adjacent_name)->second,
+							distance);
+					}
+				}
+			});
+	};
+	fill([this](StopId from, StopId to, double distance) noexcept {
+		getDistance(from, to) = distance;
+	});
+	fill([this](StopId from, StopId to, double distance) noexcept {
+		if (auto &reverse = getDistance(to, from); std::isinf(reverse)) {
+			reverse = distance;
+		}
+	});
 }
 
 detail::Bus &TransportDirectoryImpl::
-	registerBus(std::string name)
+	registerBus(std::string_view name)
 {
-	auto [it, is_new] =
-		bus_ids_.try_emplace(std::move(name), bus_ids_.size());
-	auto &bus = getBus(it->second);
-	if (is_new) {
+	auto it = bus_ids_.find(name);
+	if (it == bus_ids_.end()) {
+		auto id = static_cast<BusId>(bus_ids_.size());
+		it = bus_ids_.emplace(names_.intern(name), id).first;
+		auto &bus = getBus(id);
 		bus.name = it->first;
-		bus.id = it->second;
+		bus.id = id;
 	}
-	return bus;
+	return getBus(it->second);
 }
 
 detail::Stop &TransportDirectoryImpl::
-	registerStop(std::string name)
+	registerStop(std::string_view name)
 {
-	auto [it, is_new] = 
-		stop_ids_.try_emplace(std::move(name), stop_ids_.size());
-	auto &stop = getStop(it->second);
-	if (is_new) {
+	auto it = stop_ids_.find(name);
+	if (it == stop_ids_.end()) {
+		auto id = static_cast<StopId>(stop_ids_.size());
+		it = stop_ids_.emplace(names_.intern(name), id).first;
+		auto &stop = getStop(id);
 		stop.name = it->first;
-		stop.id = it->second;
+		stop.id = id;
 	}
-	return stop;
+	return getStop(it->second);
 }
 
-void TransportDirectoryImpl::calculateGeoDistances() noexcept
+// A row fills the upper half of itself and the lower half
+// of its column, so the rows are independent
+void TransportDirectoryImpl::calculateGeoDistances()
 {
-	auto &&stops = std::as_const(*this).getStopsList();
-	for (auto const &from : stops) {
-		for (auto const &to : stops) {
-			if (from.id <= to.id) {
-				getGeoDistance(from.id, to.id) =
-					getGeoDistance(to.id, from.id) =
-					geo::computeGeoDistance(from.coords, to.coords);
+	constexpr std::size_t kChunkSize = 16;
+	std::span stops{std::as_const(*this).getStopsList()};
+	utils::getThreadPool().parallelFor(stops.size(), kChunkSize,
+		[&](std::size_t first, std::size_t last) noexcept {
+			for (auto const &from : stops.subspan(first, last - first)) {
+				for (auto const &to : stops.subspan(from.id)) {
+					getGeoDistance(from.id, to.id) =
+						getGeoDistance(to.id, from.id) =
+						geo::computeGeoDistance(from.coords, to.coords);
+				}
 			}
-		}
-	}
+		});
 }
 
 void TransportDirectoryImpl::computeRoutes()
 {
 	fillRoutes();
 	executeWFI();
+	route_table_ = routes_;
+}
+
+void TransportDirectoryImpl::computeBusesInfo()
+{
+	constexpr std::size_t kChunkSize = 64;
+	auto &buses = getBusesList();
+	utils::getThreadPool().parallelFor(buses.size(), kChunkSize,
+		[&](std::size_t first, std::size_t last) {
+			for (auto i = first; i != last; ++i) {
+				buses[i].info = makeBusInfo(buses[i]);
+			}
+		});
 }
 
 //     
@@ -203,82 +334,124 @@ void TransportDirectoryImpl::fillRoutes()
 //      
 void TransportDirectoryImpl::executeWFI()
 {
+	constexpr std::size_t kChunkSize = 16;
+	auto &pool = utils::getThreadPool();
 	auto &&stops = std::as_const(*this).getStopsList();
 	for (auto const &middle : stops) {
-		for (auto const &from : stops) {
-			for (auto const &to : stops) {
-				auto &route = getRoute(from.id, to.id);
-				auto old_time = route.time;
-				auto new_time =
-					getRoute(from.id, middle.id).time +
-					routing_settings_.wait_time +
-				   	getRoute(middle.id, to.id).time;
-				if (new_time < old_time) {
-					route = {
-						.time = new_time,
-						.item = detail::Route::Transfer{
-							.from = from.id,
-						   	.middle = middle.id,
-							.to = to.id,
-						},
-					};
+		// the times are not negative, so neither the row nor the column
+		// of the middle stop change, and the other rows are independent
+		pool.parallelFor(stops.size(), kChunkSize,
+			[&](std::size_t first, std::size_t last) noexcept {
+				for (auto from = first; from != last; ++from) {
+					relaxRoutes(static_cast<StopId>(from), middle.id);
 				}
-			}
+			});
+	}
+}
+
+void TransportDirectoryImpl::relaxRoutes(StopId from, StopId middle) noexcept
+{
+	auto first_time = getRoute(from, middle).time +
+		routing_settings_.wait_time;
+	for (auto const &to : std::as_const(*this).getStopsList()) {
+		auto &route = getRoute(from, to.id);
+		auto new_time = first_time + getRoute(middle, to.id).time;
+		if (new_time < route.time) {
+			route = {
+				.time = new_time,
+				.item = detail::Route::Transfer{
+					.from = from,
+					.middle = middle,
+					.to = to.id,
+				},
+			};
 		}
 	}
 }
 
-std::optional<info::Bus> TransportDirectoryImpl::getBus(
-	std::string const &name) const
+std::optional<detail::BusId> TransportDirectoryImpl::
+	findBus(std::string_view name) const
 {
 	auto it = bus_ids_.find(name);
 	if (it == bus_ids_.end()) {
 		return std::nullopt;
 	}
-	return makeBusInfo(getBus(it->second));
+	return it->second;
 }
 
-std::optional<info::Stop> TransportDirectoryImpl::getStop(
-	std::string const &name) const
+std::optional<detail::StopId> TransportDirectoryImpl::
+	findStop(std::string_view name) const
 {
 	auto it = stop_ids_.find(name);
 	if (it == stop_ids_.end()) {
 		return std::nullopt;
 	}
-	return makeStopInfo(getStop(it->second));
+	return it->second;
 }
 
-std::optional<info::Route> TransportDirectoryImpl::getRoute(
-	std::string const &source, std::string const &destination) const
+info::Bus TransportDirectoryImpl::getBusInfo(BusId id) const
 {
-	auto from_it = stop_ids_.find(source);
-	if (from_it == stop_ids_.end()) {
-		return std::nullopt;
-	}
-	auto to_it = stop_ids_.find(destination);
-	if (to_it == stop_ids_.end()) {
-		return std::nullopt;
-	}
-	if (from_it == to_it) {
+	return getBus(id).info;
+}
+
+info::Stop TransportDirectoryImpl::getStopInfo(StopId id) const
+{
+	return makeStopInfo(getStop(id));
+}
+
+std::optional<info::Route> TransportDirectoryImpl::
+	getRouteInfo(StopId from, StopId to) const
+{
+	if (from == to) {
 		return std::optional<info::Route>{std::in_place};
 	}
-	auto const &route = getRoute(from_it->second, to_it->second);
+	auto const &route = getRoute(from, to);
 	if (not std::isfinite(route.time)) {
 		return std::nullopt;
 	}
 	return makeRouteInfo(route);
 }
 
+// A snapshot comes with the map, otherwise it is rendered on first use
 info::Map TransportDirectoryImpl::getMap() const
 {
-	if (map_.empty()) {
+	std::lock_guard lock{map_mutex_};
+	if (map_view_.empty()) {
 		map_ = TransportDirectoryRenderer{
 			buses_,
 			stops_,
 			render_settings_
 		}.renderMap();
+		map_view_ = map_;
+	}
+	return {.data = map_view_};
+}
+
+info::MemoryUsage TransportDirectoryImpl::getMemoryUsage() const
+{
+	std::size_t map_bytes;
+	{
+		std::lock_guard lock{map_mutex_};
+		map_bytes = utils::getHeapBytes(map_);
 	}
-	return {.data = map_};
+	auto arena_bytes = arena_memory_.getBytes();
+	return {
+		.structures = {
+			{"names", names_memory_.getBytes()},
+			{"bus_ids", bus_ids_memory_.getBytes()},
+			{"buses", buses_memory_.getBytes()},
+			{"stop_ids", stop_ids_memory_.getBytes()},
+			{"stops", stops_memory_.getBytes()},
+			{"distances", distances_memory_.getBytes()},
+			{"geo_distances", geo_distances_memory_.getBytes()},
+			{"routes", routes_memory_.getBytes()},
+			{"arena", arena_bytes},
+			{"map", map_bytes},
+			{"snapshot", snapshot_.size()},
+		},
+		.peak_rss = peak_rss_,
+		.total = arena_bytes + map_bytes + snapshot_.size(),
+	};
 }
 
 info::Bus TransportDirectoryImpl::makeBusInfo(detail::Bus const &bus) const
@@ -35,8 +35,8 @@ std::string TransportDirectoryRenderer::renderMap() const
 }
 
 TransportDirectoryRenderer::TransportDirectoryRenderer(
-	std::vector<detail::Bus> const &buses,
-	std::vector<detail::Stop> const &stops,
+	std::span<detail::Bus const> buses,
+	std::span<detail::Stop const> stops,
 	config::RenderSettings const &settings
 )
 	: buses_{buses}
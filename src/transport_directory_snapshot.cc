@@ -0,0 +1,312 @@
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <span>
+#include <stdexcept>
+#include <string_view>
+#include <variant>
+#include <vector>
+
+#include "transport_directory_impl.h"
+#include "transport_directory_snapshot.h"
+
+namespace transport {
+
+namespace {
+
+class SnapshotWriter {
+public:
+	explicit SnapshotWriter(std::string const &path)
+		: os_{path, std::ios::binary | std::ios::trunc}
+	{
+		if (not os_) {
+			throw std::runtime_error{"cannot open " + path};
+		}
+		// the header is written last, when all sections are known
+		pad(sizeof(snapshot::Header));
+	}
+
+	template <typename T>
+	snapshot::Section write(std::span<T const> data)
+	{
+		pad(-offset_ % snapshot::kAlignment);
+		snapshot::Section section{.offset = offset_, .size = data.size_bytes()};
+		os_.write(
+			static_cast<char const *>(static_cast<void const *>(data.data())),
+			static_cast<std::streamsize>(data.size_bytes())
+		);
+		offset_ += data.size_bytes();
+		return section;
+	}
+
+	void finish(snapshot::Header const &header)
+	{
+		os_.seekp(0);
+		os_.write(
+			static_cast<char const *>(static_cast<void const *>(&header)),
+			sizeof(header)
+		);
+		os_.flush();
+		if (not os_) {
+			throw std::runtime_error{"cannot write snapshot"};
+		}
+	}
+
+private:
+	void pad(std::uint64_t size)
+	{
+		for (; size != 0; --size) {
+			os_.put('\0');
+		}
+		offset_ = static_cast<std::uint64_t>(os_.tellp());
+	}
+
+private:
+	std::ofstream os_;
+	std::uint64_t offset_ = 0;
+};
+
+void check(bool condition, char const *what)
+{
+	if (not condition) {
+		throw std::runtime_error{
+			std::string{"invalid snapshot: "} + what
+		};
+	}
+}
+
+[[nodiscard]] snapshot::Header readHeader(utils::MappedFile const &file)
+{
+	snapshot::Header header;
+	check(file.size() >= sizeof(header), "too short");
+	std::memcpy(&header, file.data(), sizeof(header));
+	check(header.magic == snapshot::kMagic, "bad magic");
+	check(header.version == snapshot::kVersion, "unsupported version");
+	check(header.route_size == sizeof(detail::Route), "incompatible build");
+	// ids are 16 bit
+	constexpr std::uint64_t kMaxCount =
+		std::uint64_t{std::numeric_limits<detail::StopId>::max()} + 1;
+	static_assert(std::numeric_limits<detail::BusId>::max() + 1 == kMaxCount);
+	check(header.stops_count <= kMaxCount and
+		header.buses_count <= kMaxCount, "too many stops or buses");
+	for (auto section : {header.names, header.stops, header.buses,
+			header.bus_routes, header.stop_buses, header.routes, header.map}) {
+		check(section.offset % snapshot::kAlignment == 0, "misaligned");
+		check(section.offset <= file.size() and
+			section.size <= file.size() - section.offset, "truncated");
+	}
+	check(header.stops.size == header.stops_count * sizeof(snapshot::Stop) and
+		header.buses.size == header.buses_count * sizeof(snapshot::Bus) and
+		header.routes.size == header.stops_count * header.stops_count *
+			sizeof(detail::Route), "inconsistent sizes");
+	return header;
+}
+
+template <typename T>
+[[nodiscard]] std::span<T const> getSection(
+	utils::MappedFile const &file, snapshot::Section section) noexcept
+{
+	return {
+		static_cast<T const *>(
+			static_cast<void const *>(file.data() + section.offset)
+		),
+		section.size / sizeof(T)
+	};
+}
+
+// Only the routes that are found are followed. A transfer is followed
+// to the two routes it is made of, which must take less time than it,
+// so that splitting a route into its parts always comes to an end
+void checkRoutes(std::span<detail::Route const> routes,
+	snapshot::Header const &header)
+{
+	auto const stops_count = header.stops_count;
+	auto getTime = [routes, stops_count](std::uint64_t from,
+			std::uint64_t to) {
+		return routes[from * stops_count + to].time;
+	};
+	for (std::uint64_t from = 0; from != stops_count; ++from) {
+		for (std::uint64_t to = 0; to != stops_count; ++to) {
+			auto const &route = routes[from * stops_count + to];
+			if (not std::isfinite(route.time)) {
+				continue;
+			}
+			if (auto const *span =
+					std::get_if<detail::Route::Span>(&route.item)) {
+				check(span->from == from and
+					span->bus < header.buses_count, "bad route");
+			} else if (auto const *transfer =
+					std::get_if<detail::Route::Transfer>(&route.item)) {
+				auto middle = transfer->middle;
+				check(transfer->from == from and transfer->to == to and
+					middle < stops_count and middle != from and
+					middle != to and
+					getTime(from, middle) < route.time and
+					getTime(middle, to) < route.time, "bad route");
+			} else {
+				check(false, "bad route");
+			}
+		}
+	}
+}
+
+[[nodiscard]] std::size_t
+	estimateSnapshotArenaSize(snapshot::Header const &header)
+{
+	return header.stops.size + header.buses.size +
+		header.bus_routes.size + header.stop_buses.size + 1;
+}
+
+} // namespace transport::anonymous
+
+void TransportDirectoryImpl::saveSnapshot(std::string const &path) const
+{
+	std::vector<char> names;
+	auto addName = [&names](std::string_view name) {
+		snapshot::String str{.offset = names.size(), .size = name.size()};
+		names.insert(names.end(), name.begin(), name.end());
+		return str;
+	};
+
+	std::vector<snapshot::Stop> stops;
+	std::vector<BusId> stop_buses;
+	stops.reserve(getStopsCount());
+	for (auto const &stop : getStopsList()) {
+		stops.push_back({
+			.name = addName(stop.name),
+			.buses_begin = stop_buses.size(),
+			.buses_count = stop.buses.size(),
+		});
+		auto first = stop_buses.insert(
+			stop_buses.end(),
+			stop.buses.begin(),
+			stop.buses.end()
+		);
+		std::sort(first, stop_buses.end(), [this](BusId lhs, BusId rhs) {
+			return getBus(lhs).name < getBus(rhs).name;
+		});
+	}
+
+	std::vector<snapshot::Bus> buses;
+	std::vector<StopId> bus_routes;
+	buses.reserve(getBusesCount());
+	for (auto const &bus : getBusesList()) {
+		buses.push_back({
+			.name = addName(bus.name),
+			.route_begin = bus_routes.size(),
+			.route_count = bus.route.size(),
+			.unique_stops_count = bus.info.unique_stops_count,
+			.road_route_length = bus.info.road_route_length,
+			.geo_route_length = bus.info.geo_route_length,
+			.is_roundtrip = bus.is_roundtrip,
+		});
+		bus_routes.insert(bus_routes.end(), bus.route.begin(), bus.route.end());
+	}
+
+	auto map = getMap().data;
+
+	SnapshotWriter writer{path};
+	snapshot::Header header{
+		.magic = snapshot::kMagic,
+		.version = snapshot::kVersion,
+		.route_size = sizeof(detail::Route),
+		.stops_count = getStopsCount(),
+		.buses_count = getBusesCount(),
+		.wait_time = routing_settings_.wait_time,
+		.names = writer.write(std::span<char const>{names}),
+		.stops = writer.write(std::span<snapshot::Stop const>{stops}),
+		.buses = writer.write(std::span<snapshot::Bus const>{buses}),
+		.bus_routes = writer.write(std::span<StopId const>{bus_routes}),
+		.stop_buses = writer.write(std::span<BusId const>{stop_buses}),
+		.routes = writer.write(route_table_),
+		.map = writer.write(std::span<char const>{map}),
+	};
+	writer.finish(header);
+}
+
+// Only the lists of stops and buses are rebuilt, the names,
+// the route table and the map are used in place
+TransportDirectoryImpl::TransportDirectoryImpl(utils::MappedFile snapshot)
+	: arena_{estimateSnapshotArenaSize(readHeader(snapshot)), &arena_memory_}
+	, names_{0, &names_memory_}
+	, bus_ids_{&bus_ids_memory_}
+	, buses_{&buses_memory_}
+	, stop_ids_{&stop_ids_memory_}
+	, stops_{&stops_memory_}
+	, distances_{&distances_memory_}
+	, geo_distances_{&geo_distances_memory_}
+	, routes_{&routes_memory_}
+	, routing_settings_{}
+	, render_settings_{}
+	, snapshot_{std::move(snapshot)}
+{
+	auto const header = readHeader(snapshot_);
+	routing_settings_.wait_time = header.wait_time;
+
+	auto names = snapshot_.view().substr(
+		header.names.offset,
+		header.names.size
+	);
+	auto getName = [names](snapshot::String str) {
+		check(str.offset <= names.size() and
+			str.size <= names.size() - str.offset, "bad name");
+		return names.substr(str.offset, str.size);
+	};
+
+	auto stop_buses = getSection<BusId>(snapshot_, header.stop_buses);
+	check(std::all_of(stop_buses.begin(), stop_buses.end(),
+		[&header](BusId bus) {
+			return bus < header.buses_count;
+		}), "bad bus of a stop");
+	stop_ids_.reserve(header.stops_count);
+	stops_.reserve(header.stops_count);
+	auto stops = getSection<snapshot::Stop>(snapshot_, header.stops);
+	for (auto const &stop : stops) {
+		check(stop.buses_begin <= stop_buses.size() and
+			stop.buses_count <= stop_buses.size() - stop.buses_begin,
+			"bad stop");
+		auto buses = stop_buses.subspan(stop.buses_begin, stop.buses_count);
+		auto &new_stop = stops_.emplace_back(detail::Stop{
+			.id = static_cast<StopId>(stops_.size()),
+			.name = getName(stop.name),
+			.coords = {},
+			.buses = {buses.begin(), buses.end(), &stops_memory_},
+		});
+		stop_ids_.emplace(new_stop.name, new_stop.id);
+	}
+
+	auto bus_routes = getSection<StopId>(snapshot_, header.bus_routes);
+	check(std::all_of(bus_routes.begin(), bus_routes.end(),
+		[&header](StopId stop) {
+			return stop < header.stops_count;
+		}), "bad stop of a bus");
+	bus_ids_.reserve(header.buses_count);
+	buses_.reserve(header.buses_count);
+	for (auto const &bus : getSection<snapshot::Bus>(snapshot_, header.buses)) {
+		check(bus.route_begin <= bus_routes.size() and
+			bus.route_count <= bus_routes.size() - bus.route_begin,
+			"bad bus");
+		auto route = bus_routes.subspan(bus.route_begin, bus.route_count);
+		auto &new_bus = buses_.emplace_back(detail::Bus{
+			.id = static_cast<BusId>(buses_.size()),
+			.name = getName(bus.name),
+			.route = {route.begin(), route.end(), &buses_memory_},
+			.is_roundtrip = bus.is_roundtrip != 0,
+			.info = {
+				.stops_count = bus.route_count,
+				.unique_stops_count = bus.unique_stops_count,
+				.road_route_length = bus.road_route_length,
+				.geo_route_length = bus.geo_route_length,
+			},
+		});
+		bus_ids_.emplace(new_bus.name, new_bus.id);
+	}
+
+	route_table_ = getSection<detail::Route>(snapshot_, header.routes);
+	checkRoutes(route_table_, header);
+	map_view_ = snapshot_.view().substr(header.map.offset, header.map.size);
+}
+
+} // namespace transport
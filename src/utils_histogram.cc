@@ -0,0 +1,70 @@
+#include <algorithm>
+#include <limits>
+
+#include "utils_histogram.h"
+
+namespace utils {
+
+// A percentile is the highest value of the bucket in which the count
+// of the values up to it reaches its share, no higher than the maximum
+HistogramSummary Histogram::summarize() const noexcept
+{
+	std::array<std::uint64_t, kBucketsCount> counts{};
+	std::uint64_t count = 0;
+	for (std::size_t i = 0; i != kBucketsCount; ++i) {
+		counts[i] = buckets_[i].load(std::memory_order_relaxed);
+		count += counts[i];
+	}
+	HistogramSummary summary{
+		.count = count,
+		.total = total_.load(std::memory_order_relaxed),
+		.max = max_.load(std::memory_order_relaxed),
+		.p50 = 0,
+		.p90 = 0,
+		.p99 = 0,
+		.p999 = 0,
+	};
+	if (count == 0) {
+		return summary;
+	}
+
+	struct Percentile {
+		// in thousandths
+		std::uint64_t share;
+		std::uint64_t *value;
+	};
+	std::array<Percentile, 4> percentiles{{
+		{500, &summary.p50},
+		{900, &summary.p90},
+		{990, &summary.p99},
+		{999, &summary.p999},
+	}};
+	std::uint64_t seen = 0;
+	auto percentile = percentiles.begin();
+	for (std::size_t i = 0; i != kBucketsCount and
+			percentile != percentiles.end(); ++i) {
+		seen += counts[i];
+		while (percentile != percentiles.end() and
+				seen * 1000 >= count * percentile->share) {
+			auto highest = i + 1 != kBucketsCount ?
+				getBucketValue(i + 1) - 1 :
+				std::numeric_limits<std::uint64_t>::max();
+			*percentile->value = std::min(highest, summary.max);
+			++percentile;
+		}
+	}
+	return summary;
+}
+
+std::uint64_t Histogram::getBucketValue(std::size_t index) noexcept
+{
+	if (index < kSubBucketsCount) {
+		return index;
+	}
+	auto exponent = index / kSubBucketsCount + kSubBits - 1;
+	auto sub_bucket = index % kSubBucketsCount;
+	return std::uint64_t{kSubBucketsCount + sub_bucket} <<
+		(exponent - kSubBits);
+}
+
+} // namespace utils
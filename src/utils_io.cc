@@ -0,0 +1,95 @@
+#include <cerrno>
+#include <cstring>
+#include <system_error>
+#include <utility>
+
+#include <unistd.h>
+
+#include "utils_io.h"
+
+namespace utils {
+
+FileDescriptor::FileDescriptor(FileDescriptor &&other) noexcept
+	: fd_{std::exchange(other.fd_, -1)}
+{
+}
+
+FileDescriptor &FileDescriptor::operator=(FileDescriptor &&other) noexcept
+{
+	if (this != &other) {
+		if (fd_ >= 0) {
+			::close(fd_);
+		}
+		fd_ = std::exchange(other.fd_, -1);
+	}
+	return *this;
+}
+
+FileDescriptor::~FileDescriptor()
+{
+	if (fd_ >= 0) {
+		::close(fd_);
+	}
+}
+
+void writeAll(int fd, std::string_view data)
+{
+	while (not data.empty()) {
+		auto n = ::write(fd, data.data(), data.size());
+		if (n < 0 and errno == EINTR) {
+			continue;
+		}
+		if (n < 0) {
+			throw std::system_error{errno, std::generic_category(), "write"};
+		}
+		data.remove_prefix(static_cast<std::size_t>(n));
+	}
+}
+
+LineReader::LineReader(int fd) noexcept
+	: fd_{fd}
+{
+}
+
+std::optional<std::string_view> LineReader::next()
+{
+	while (true) {
+		if (auto end = buffer_.find('\n', scanned_); end != buffer_.npos) {
+			std::string_view line{buffer_.data() + begin_, end - begin_};
+			begin_ = scanned_ = end + 1;
+			return line;
+		}
+		if (is_ended_) {
+			if (begin_ == buffer_.size()) {
+				return std::nullopt;
+			}
+			std::string_view line{buffer_.data() + begin_,
+				buffer_.size() - begin_};
+			begin_ = scanned_ = buffer_.size();
+			return line;
+		}
+
+		// the lines before begin_ are not needed any more
+		buffer_.erase(0, begin_);
+		begin_ = 0;
+		scanned_ = buffer_.size();
+		buffer_.resize(scanned_ + kReadSize);
+		auto n = ::read(fd_, buffer_.data() + scanned_, kReadSize);
+		if (n < 0 and errno != EINTR) {
+			auto error = errno;
+			buffer_.resize(scanned_);
+			throw std::system_error{error, std::generic_category(), "read"};
+		}
+		buffer_.resize(scanned_ + (n > 0 ? static_cast<std::size_t>(n) : 0));
+		is_ended_ = n == 0;
+	}
+}
+
+bool LineReader::hasLine() const noexcept
+{
+	return (is_ended_ and begin_ != buffer_.size()) or
+		std::memchr(buffer_.data() + scanned_, '\n',
+			buffer_.size() - scanned_) != nullptr;
+}
+
+} // namespace utils
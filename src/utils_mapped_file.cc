@@ -0,0 +1,71 @@
+#include <cerrno>
+#include <system_error>
+#include <utility>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "utils_mapped_file.h"
+
+namespace utils {
+
+MappedFile::MappedFile(std::string const &path)
+{
+	auto fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+	if (fd == -1) {
+		throw std::system_error{errno, std::generic_category(), path};
+	}
+	try {
+		map(fd, path);
+	} catch (...) {
+		::close(fd);
+		throw;
+	}
+	::close(fd);
+}
+
+MappedFile::MappedFile(int fd)
+{
+	map(fd, "fd " + std::to_string(fd));
+}
+
+MappedFile::~MappedFile()
+{
+	if (data_ != nullptr) {
+		::munmap(const_cast<char *>(data_), size_);
+	}
+}
+
+MappedFile::MappedFile(MappedFile &&other) noexcept
+	: data_{std::exchange(other.data_, nullptr)}
+	, size_{std::exchange(other.size_, 0)}
+{
+}
+
+MappedFile &MappedFile::operator=(MappedFile &&other) noexcept
+{
+	std::swap(data_, other.data_);
+	std::swap(size_, other.size_);
+	return *this;
+}
+
+void MappedFile::map(int fd, std::string const &name)
+{
+	struct stat st{};
+	if (::fstat(fd, &st) == -1) {
+		throw std::system_error{errno, std::generic_category(), name};
+	}
+	size_ = static_cast<std::size_t>(st.st_size);
+	if (size_ != 0) {
+		auto *p = ::mmap(nullptr, size_, PROT_READ, MAP_SHARED, fd, 0);
+		if (p == MAP_FAILED) {
+			size_ = 0;
+			throw std::system_error{errno, std::generic_category(), name};
+		}
+		data_ = static_cast<char const *>(p);
+	}
+}
+
+} // namespace utils
@@ -0,0 +1,131 @@
+#include <cerrno>
+#include <charconv>
+#include <cstdint>
+#include <cstring>
+#include <string_view>
+#include <system_error>
+
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "utils_socket.h"
+
+namespace utils {
+
+namespace {
+
+constexpr std::string_view kTcpPrefix = "tcp:";
+
+// Both kinds of address fit in the storage, len is the one in use
+struct SocketAddress {
+	sockaddr_storage storage;
+	socklen_t len;
+	int family;
+};
+
+[[nodiscard]] SocketAddress parseAddress(std::string const &address);
+[[nodiscard]] bool isTcp(std::string const &address) noexcept;
+
+[[noreturn]] void fail(std::string const &address)
+{
+	throw std::system_error{errno, std::generic_category(), address};
+}
+
+} // namespace utils::anonymous
+
+FileDescriptor listenAt(std::string const &address)
+{
+	auto parsed = parseAddress(address);
+	FileDescriptor socket{::socket(parsed.family,
+		SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0)};
+	if (socket.get() < 0) {
+		fail(address);
+	}
+	if (isTcp(address)) {
+		int yes = 1;
+		::setsockopt(socket.get(), SOL_SOCKET, SO_REUSEADDR,
+			&yes, sizeof(yes));
+	} else if (struct stat st{}; ::lstat(address.c_str(), &st) == 0 and
+			S_ISSOCK(st.st_mode)) {
+		::unlink(address.c_str());
+	}
+	if (::bind(socket.get(), reinterpret_cast<sockaddr const *>(
+			&parsed.storage), parsed.len) != 0 or
+			::listen(socket.get(), SOMAXCONN) != 0) {
+		fail(address);
+	}
+	return socket;
+}
+
+FileDescriptor connectTo(std::string const &address)
+{
+	auto parsed = parseAddress(address);
+	FileDescriptor socket{::socket(parsed.family,
+		SOCK_STREAM | SOCK_CLOEXEC, 0)};
+	if (socket.get() < 0) {
+		fail(address);
+	}
+	if (::connect(socket.get(), reinterpret_cast<sockaddr const *>(
+			&parsed.storage), parsed.len) != 0) {
+		fail(address);
+	}
+	if (isTcp(address)) {
+		int yes = 1;
+		::setsockopt(socket.get(), IPPROTO_TCP, TCP_NODELAY,
+			&yes, sizeof(yes));
+	}
+	return socket;
+}
+
+void unlinkAddress(std::string const &address) noexcept
+{
+	if (not isTcp(address)) {
+		::unlink(address.c_str());
+	}
+}
+
+namespace {
+
+SocketAddress parseAddress(std::string const &address)
+{
+	SocketAddress parsed{};
+	if (isTcp(address)) {
+		std::uint16_t port{};
+		auto const *end = address.data() + address.size();
+		auto [last, error] = std::from_chars(
+			address.data() + kTcpPrefix.size(), end, port);
+		if (error != std::errc{} or last != end) {
+			throw std::system_error{EINVAL, std::generic_category(), address};
+		}
+		auto &in = reinterpret_cast<sockaddr_in &>(parsed.storage);
+		in.sin_family = AF_INET;
+		in.sin_port = htons(port);
+		in.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+		parsed.len = sizeof(sockaddr_in);
+		parsed.family = AF_INET;
+		return parsed;
+	}
+	auto &un = reinterpret_cast<sockaddr_un &>(parsed.storage);
+	if (address.empty() or address.size() >= sizeof(un.sun_path)) {
+		throw std::system_error{address.empty() ? EINVAL : ENAMETOOLONG,
+			std::generic_category(), address};
+	}
+	un.sun_family = AF_UNIX;
+	std::memcpy(un.sun_path, address.c_str(), address.size() + 1);
+	parsed.len = sizeof(sockaddr_un);
+	parsed.family = AF_UNIX;
+	return parsed;
+}
+
+bool isTcp(std::string const &address) noexcept
+{
+	return address.starts_with(kTcpPrefix);
+}
+
+} // namespace utils::anonymous
+
+} // namespace utils
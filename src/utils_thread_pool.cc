@@ -0,0 +1,152 @@
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <memory>
+#include <utility>
+
+#include "utils_thread_pool.h"
+
+namespace utils {
+
+namespace {
+
+// The state of a parallelFor. It is shared with the tasks, as those
+// that start after the loop is done still have to look at it
+struct Loop {
+	void run();
+
+	ThreadPool::Body const *body;
+	std::size_t count;
+	std::size_t chunk_size;
+	std::size_t chunks_count;
+
+	std::atomic<std::size_t> next_chunk{0};
+	std::atomic<bool> is_failed{false};
+
+	std::mutex mutex;
+	std::condition_variable is_done;
+	std::size_t done_count = 0;
+	std::exception_ptr error;
+};
+
+} // namespace utils::anonymous
+
+ThreadPool::ThreadPool(std::size_t threads_count)
+{
+	threads_.reserve(threads_count);
+	for (std::size_t i = 0; i != threads_count; ++i) {
+		threads_.emplace_back([this] { work(); });
+	}
+}
+
+ThreadPool::~ThreadPool()
+{
+	{
+		std::lock_guard lock{mutex_};
+		is_stopped_ = true;
+	}
+	has_tasks_.notify_all();
+	for (auto &thread : threads_) {
+		thread.join();
+	}
+}
+
+std::size_t ThreadPool::size() const noexcept
+{
+	return threads_.size();
+}
+
+void ThreadPool::parallelFor(std::size_t count, std::size_t chunk_size,
+	Body const &body)
+{
+	chunk_size = std::max(chunk_size, std::size_t{1});
+	auto chunks_count = (count + chunk_size - 1) / chunk_size;
+	if (chunks_count <= 1 or threads_.empty()) {
+		if (count != 0) {
+			body(0, count);
+		}
+		return;
+	}
+
+	auto loop = std::make_shared<Loop>();
+	loop->body = &body;
+	loop->count = count;
+	loop->chunk_size = chunk_size;
+	loop->chunks_count = chunks_count;
+	{
+		std::lock_guard lock{mutex_};
+		auto helpers_count = std::min(threads_.size(), chunks_count - 1);
+		for (std::size_t i = 0; i != helpers_count; ++i) {
+			tasks_.emplace_back([loop] { loop->run(); });
+		}
+	}
+	has_tasks_.notify_all();
+
+	loop->run();
+	std::unique_lock lock{loop->mutex};
+	loop->is_done.wait(lock, [&loop] {
+		return loop->done_count == loop->chunks_count;
+	});
+	if (loop->error) {
+		std::rethrow_exception(loop->error);
+	}
+}
+
+void ThreadPool::work()
+{
+	for (;;) {
+		std::function<void()> task;
+		{
+			std::unique_lock lock{mutex_};
+			has_tasks_.wait(lock, [this] {
+				return is_stopped_ or not tasks_.empty();
+			});
+			if (tasks_.empty()) {
+				return;
+			}
+			task = std::move(tasks_.front());
+			tasks_.pop_front();
+		}
+		task();
+	}
+}
+
+ThreadPool &getThreadPool()
+{
+	static ThreadPool pool{
+		std::max(std::thread::hardware_concurrency(), 1u) - 1
+	};
+	return pool;
+}
+
+namespace {
+
+void Loop::run()
+{
+	for (;;) {
+		auto chunk = next_chunk.fetch_add(1, std::memory_order_relaxed);
+		if (chunk >= chunks_count) {
+			return;
+		}
+		if (not is_failed.load(std::memory_order_relaxed)) {
+			auto first = chunk * chunk_size;
+			try {
+				(*body)(first, std::min(first + chunk_size, count));
+			} catch (...) {
+				std::lock_guard lock{mutex};
+				if (not error) {
+					error = std::current_exception();
+				}
+				is_failed.store(true, std::memory_order_relaxed);
+			}
+		}
+		std::lock_guard lock{mutex};
+		if (++done_count == chunks_count) {
+			is_done.notify_all();
+		}
+	}
+}
+
+} // namespace utils::anonymous
+
+} // namespace utils
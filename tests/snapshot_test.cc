@@ -0,0 +1,114 @@
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+
+#include "description.h"
+#include "json_view.h"
+#include "transport_directory.h"
+#include "transport_directory_snapshot.h"
+
+namespace {
+
+constexpr std::string_view kInput = R"({
+	"base_requests": [
+		{"type": "Stop", "name": "A", "latitude": 55.61, "longitude": 37.20,
+			"road_distances": {"B": 3000}},
+		{"type": "Stop", "name": "B", "latitude": 55.59, "longitude": 37.21,
+			"road_distances": {"C": 4000}},
+		{"type": "Stop", "name": "C", "latitude": 55.60, "longitude": 37.22,
+			"road_distances": {"A": 5000}},
+		{"type": "Bus", "name": "1", "stops": ["A", "B", "C", "A"],
+			"is_roundtrip": true}
+	],
+	"routing_settings": {"bus_wait_time": 6, "bus_velocity": 40},
+	"render_settings": {
+		"width": 1200, "height": 500, "padding": 50, "stop_radius": 5,
+		"line_width": 14, "bus_label_font_size": 20,
+		"bus_label_offset": [7, 15], "stop_label_font_size": 18,
+		"stop_label_offset": [7, -3], "underlayer_color": [255, 255, 255, 0.85],
+		"underlayer_width": 3, "color_palette": ["green", [255, 160, 0]],
+		"layers": ["bus_lines", "bus_labels", "stop_points", "stop_labels"]
+	}
+})";
+
+void saveSnapshot(std::string const &path)
+{
+	json::Reader reader{kInput};
+	transport::TransportDirectory directory{
+		description::readConfig(reader)
+	};
+	directory.saveSnapshot(path);
+}
+
+// The route from the first stop to the second as a transfer at the first
+// stop, which is then split into the same route over and over
+void corruptRoutes(std::string const &path)
+{
+	std::fstream file{path, std::ios::binary | std::ios::in | std::ios::out};
+	transport::snapshot::Header header;
+	file.read(static_cast<char *>(static_cast<void *>(&header)),
+		sizeof(header));
+	transport::detail::Route const routes[] = {
+		{
+			.time = 1.0,
+			.item = transport::detail::Route::Span{
+				.from = 0,
+				.bus = 0,
+				.spans_count = 1,
+			},
+		},
+		{
+			.time = 2.0,
+			.item = transport::detail::Route::Transfer{
+				.from = 0,
+				.middle = 0,
+				.to = 1,
+			},
+		},
+	};
+	file.seekp(static_cast<std::streamoff>(header.routes.offset));
+	file.write(static_cast<char const *>(static_cast<void const *>(routes)),
+		sizeof(routes));
+	if (not file) {
+		throw std::runtime_error{"cannot corrupt " + path};
+	}
+}
+
+[[nodiscard]] std::string loadSnapshot(std::string const &path)
+{
+	try {
+		auto directory = transport::TransportDirectory::loadSnapshot(path);
+	} catch (std::runtime_error const &e) {
+		return e.what();
+	}
+	return {};
+}
+
+} // namespace anonymous
+
+int main()
+{
+	auto path = (std::filesystem::temp_directory_path() /
+		"transport-directory-snapshot-test.snap").string();
+	saveSnapshot(path);
+	auto error = loadSnapshot(path);
+	if (not error.empty()) {
+		std::cerr << "valid snapshot rejected: " << error << '\n';
+		return 1;
+	}
+
+	corruptRoutes(path);
+	error = loadSnapshot(path);
+	std::remove(path.c_str());
+	if (error != "invalid snapshot: bad route") {
+		std::cerr << "corrupt snapshot not rejected as a bad route: " <<
+			error << '\n';
+		return 1;
+	}
+	return 0;
+}